@@ -0,0 +1,148 @@
+/*
+
+  splits a buffer of realistic rows into name and temperature and times
+  the scalar byte loop against the vectorized cut() and the block scanner.
+
+  names follow the 1brc station list, mostly 5 to 12 bytes with a long
+  tail up to 40, so most delimiters sit inside the first vector.
+
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include "q_strings.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ROWS (4 * 1000 * 1000)
+#define REPS 5
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+// mostly short names with the occasional long one
+static int name_len(uint64_t *seed) {
+  uint64_t r = next_rand(seed) % 100;
+  if (r < 90) {
+    return 5 + (int)(next_rand(seed) % 8);
+  }
+  return 13 + (int)(next_rand(seed) % 28);
+}
+
+static str gen_rows(ptrdiff_t rows) {
+  ptrdiff_t cap = rows * 48;
+  unsigned char *buf = malloc(cap);
+  if (buf == NULL) {
+    return (str){0};
+  }
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  ptrdiff_t n = 0;
+  for (ptrdiff_t r = 0; r < rows; r++) {
+    int len = name_len(&seed);
+    for (int i = 0; i < len; i++) {
+      buf[n++] = 'a' + next_rand(&seed) % 26;
+    }
+    n += snprintf((char *)buf + n, cap - n, ";%d.%d\n",
+                  (int)(next_rand(&seed) % 199) - 99,
+                  (int)(next_rand(&seed) % 10));
+  }
+  return slice(buf, buf + n);
+}
+
+static snip scalar_cut(str s, char c) {
+  snip n = {0};
+  if (!s.len) {
+    return n;
+  }
+  unsigned char *end = s.data + s.len;
+  unsigned char *cut = s.data;
+  for (; cut < end && *cut != c; cut++)
+    ;
+  n.ok = cut < end;
+  n.head = slice(s.data, cut);
+  n.tail = slice(n.ok ? cut + 1 : cut, end);
+  return n;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// sum of name lengths so the work can't be optimized away
+static int64_t run_scalar(str in) {
+  int64_t sum = 0;
+  while (in.len) {
+    snip name = scalar_cut(in, ';');
+    snip temp = scalar_cut(name.tail, '\n');
+    sum += name.head.len;
+    in = temp.tail;
+  }
+  return sum;
+}
+
+static int64_t run_cut(str in) {
+  int64_t sum = 0;
+  while (in.len) {
+    snip name = cut(in, ';');
+    snip temp = cut(name.tail, '\n');
+    sum += name.head.len;
+    in = temp.tail;
+  }
+  return sum;
+}
+
+// one scan per 64 bytes, rows are walked through the bitmasks
+static int64_t run_blocks(str in) {
+  int64_t sum = 0;
+  ptrdiff_t row = 0;
+  ptrdiff_t semi = 0;
+  for (ptrdiff_t off = 0; off < in.len; off += DELIM_BLOCK) {
+    delims d = scan_delims(slice(in.data + off, in.data + in.len));
+    uint64_t all = d.semi | d.nl;
+    while (all) {
+      int bit = __builtin_ctzll(all);
+      all &= all - 1;
+      if ((d.semi >> bit) & 1) {
+        semi = off + bit;
+      } else {
+        sum += semi - row;
+        row = off + bit + 1;
+      }
+    }
+  }
+  return sum;
+}
+
+static void report(const char *name, int64_t (*fn)(str), str in) {
+  double best = 1e30;
+  int64_t check = 0;
+  for (int i = 0; i < REPS; i++) {
+    double t = now();
+    check = fn(in);
+    t = now() - t;
+    best = t < best ? t : best;
+  }
+  fprintf(stdout, "%-8s %8.2f ns/row %8.2f GB/s (check %lld)\n", name,
+          best * 1e9 / ROWS, in.len / best * 1e-9, (long long)check);
+}
+
+int main(void) {
+  str in = gen_rows(ROWS);
+  if (!in.data) {
+    return EXIT_FAILURE;
+  }
+  fprintf(stdout, "%d rows, %td bytes\n", ROWS, in.len);
+  report("scalar", run_scalar, in);
+  report("cut", run_cut, in);
+  report("blocks", run_blocks, in);
+  free(in.data);
+  return EXIT_SUCCESS;
+}
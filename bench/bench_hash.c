@@ -0,0 +1,172 @@
+/*
+
+  compares the old ht scheme, byte at a time fnv-1a with a 64-bit modulo
+  by a 1.5x grown capacity, against hash_bytes with power of two
+  capacities indexed by shift and probed by mask.
+
+  keys are synthetic station names, 3 to 26 bytes built from syllables
+  with the odd space, and the lookup stream draws from them uniformly
+  the way rows do. both tables use linear probing at the same max load.
+
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include "hash.h"
+#include "q_strings.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUPS (8 * 1000 * 1000)
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static const char *SYLLABLES[] = {
+    "ba", "ka", "lo", "mar", "ste", "ville", "burg", "an", "de", "ri",
+    "os", "ton", "ham", "el", "sa", "ja", "qu", "ne", "port", "u",
+};
+#define N_SYLLABLES (sizeof(SYLLABLES) / sizeof(SYLLABLES[0]))
+
+// random syllables, a '-' and i in base 20 as syllables. no syllable
+// holds a '-' or is the start of another, so every i gives its own name
+// null data if it can't be allocated
+static str gen_name(size_t i, uint64_t *seed) {
+  char buf[64];
+  int n = 0;
+  int parts = 1 + (int)(next_rand(seed) % 4);
+  for (int p = 0; p < parts; p++) {
+    n += snprintf(buf + n, sizeof(buf) - n, "%s",
+                  SYLLABLES[next_rand(seed) % N_SYLLABLES]);
+    if (p == 1 && next_rand(seed) % 4 == 0) {
+      buf[n++] = ' ';
+    }
+  }
+  buf[n++] = '-';
+  do {
+    n += snprintf(buf + n, sizeof(buf) - n, "%s", SYLLABLES[i % N_SYLLABLES]);
+    i /= N_SYLLABLES;
+  } while (i);
+
+  unsigned char *p = malloc(n);
+  if (p == NULL) {
+    return (str){0};
+  }
+  memcpy(p, buf, n);
+  return (str){.data = p, .len = n};
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t fnv(str key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (ptrdiff_t i = 0; i < key.len; i++) {
+    hash ^= key.data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+typedef struct {
+  str *keys;
+  size_t cap;
+  uint64_t probes;
+  uint64_t max_probe;
+} table;
+
+// keys are pointers into the name list, table slots are empty at len 0
+#define DEFINE_TABLE(name, HASH, START, NEXT, GROW)                            \
+  static size_t name##_find(table *t, str key) {                               \
+    size_t cap = t->cap;                                                       \
+    uint64_t x = HASH(key) * 11400714819323198485ull;                          \
+    size_t idx = START;                                                        \
+    uint64_t probe = 1;                                                        \
+    while (t->keys[idx].len && !are_equal(t->keys[idx], key)) {                \
+      idx = NEXT;                                                              \
+      probe++;                                                                 \
+    }                                                                          \
+    t->probes += probe;                                                        \
+    t->max_probe = probe > t->max_probe ? probe : t->max_probe;                \
+    return idx;                                                                \
+  }                                                                            \
+  static void name##_build(table *t, str *names, size_t n) {                   \
+    t->cap = 8;                                                                \
+    while (n * 2 > t->cap) {                                                   \
+      t->cap = GROW;                                                           \
+    }                                                                          \
+    t->keys = calloc(t->cap, sizeof(str));                                     \
+    for (size_t i = 0; i < n; i++) {                                           \
+      t->keys[name##_find(t, names[i])] = names[i];                            \
+    }                                                                          \
+  }
+
+#define WORD_HASH(key) hash_bytes((key).data, (key).len)
+
+DEFINE_TABLE(fnv_mod, fnv, x % cap, (idx + 1) % cap, t->cap + t->cap / 2)
+DEFINE_TABLE(word_pow2, WORD_HASH, x >> (64 - __builtin_ctzll(cap)),
+             (idx + 1) & (cap - 1), t->cap * 2)
+
+#define RUN(name, names, n, order)                                             \
+  do {                                                                         \
+    table t = {0};                                                             \
+    name##_build(&t, names, n);                                                \
+    t.probes = t.max_probe = 0;                                                \
+    double start = now();                                                      \
+    size_t sink = 0;                                                           \
+    for (size_t i = 0; i < LOOKUPS; i++) {                                     \
+      sink += name##_find(&t, names[order[i]]);                                \
+    }                                                                          \
+    double took = now() - start;                                               \
+    fprintf(stdout, "  %-10s %6.2f ns/lookup  avg probe %.3f  max probe %llu" \
+                    "  cap %zu (%zu)\n",                                       \
+            #name, took * 1e9 / LOOKUPS, (double)t.probes / LOOKUPS,           \
+            (unsigned long long)t.max_probe, t.cap, sink % 2);                 \
+    free(t.keys);                                                              \
+  } while (0)
+
+int main(void) {
+  size_t sizes[] = {413, 10000};
+  uint32_t *order = malloc(LOOKUPS * sizeof(uint32_t));
+  if (order == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t n = sizes[s];
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    str *names = malloc(n * sizeof(str));
+    if (names == NULL) {
+      return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < n; i++) {
+      names[i] = gen_name(i, &seed);
+      if (names[i].data == NULL) {
+        return EXIT_FAILURE;
+      }
+    }
+    for (size_t i = 0; i < LOOKUPS; i++) {
+      order[i] = (uint32_t)(next_rand(&seed) % n);
+    }
+
+    fprintf(stdout, "%zu stations, %d lookups\n", n, LOOKUPS);
+    RUN(fnv_mod, names, n, order);
+    RUN(word_pow2, names, n, order);
+
+    for (size_t i = 0; i < n; i++) {
+      free(names[i].data);
+    }
+    free(names);
+  }
+  free(order);
+  return EXIT_SUCCESS;
+}
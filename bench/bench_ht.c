@@ -0,0 +1,216 @@
+/*
+
+  ht_insert and ht_search throughput and the shape they leave behind.
+
+  every size is filled with four key sets:
+  - stations: 3 to 26 byte names built from syllables, like real rows
+  - prefixed: 64 bytes that only differ in their last few, every probe
+    that meets an equal hash pays for the full compare
+  - numeric: decimal counters, short and low in entropy
+  - clustered: keys whose home slot is in the first eighth of the table
+    at every capacity, the worst case of linear probing. only built up
+    to CLUSTER_MAX keys, past that a run takes minutes
+
+  inserts are timed one at a time so a resize shows up on its own: the
+  load it happened at and how long it took. searches are for present keys
+  in random order, and for keys that are not in the table.
+
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include "hash.h"
+#include "hash_table.h"
+#include "q_strings.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUPS (4 * 1000 * 1000)
+#define CLUSTER_MAX 10000
+#define CLUSTER_LOOKUPS (100 * 1000)
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char *SYLLABLES[] = {
+    "ba", "ka", "lo", "mar", "ste", "ville", "burg", "an", "de", "ri",
+    "os", "ton", "ham", "el", "sa", "ja", "qu", "ne", "port", "u",
+};
+#define N_SYLLABLES (sizeof(SYLLABLES) / sizeof(SYLLABLES[0]))
+
+static str copy_key(const char *buf, int n) {
+  unsigned char *p = malloc(n);
+  memcpy(p, buf, n);
+  return (str){.data = p, .len = n};
+}
+
+// every set marks its absent keys with a byte no present key has there
+// a random prefix, a '-' and i in base 20 as syllables. no syllable is
+// the start of another, so with the '-' no two i give the same key
+static str station_key(size_t i, bool absent, uint64_t *seed) {
+  char buf[64];
+  int n = absent ? snprintf(buf, sizeof(buf), "~") : 0;
+  int parts = 1 + (int)(next_rand(seed) % 4);
+  for (int p = 0; p < parts; p++) {
+    n += snprintf(buf + n, sizeof(buf) - n, "%s",
+                  SYLLABLES[next_rand(seed) % N_SYLLABLES]);
+  }
+  buf[n++] = '-';
+  do {
+    n += snprintf(buf + n, sizeof(buf) - n, "%s", SYLLABLES[i % N_SYLLABLES]);
+    i /= N_SYLLABLES;
+  } while (i);
+  return copy_key(buf, n);
+}
+
+static str prefixed_key(size_t i, bool absent, uint64_t *seed) {
+  (void)seed;
+  char buf[80];
+  int n = snprintf(buf, sizeof(buf), "%064zu", i);
+  memset(buf, absent ? 'q' : 'p', n - 10);
+  return copy_key(buf, n);
+}
+
+static str numeric_key(size_t i, bool absent, uint64_t *seed) {
+  (void)seed;
+  char buf[32];
+  return copy_key(buf,
+                  snprintf(buf, sizeof(buf), "%s%zu", absent ? "-" : "", i));
+}
+
+// the table indexes by the top bits of the fibonacci scrambled hash, so
+// a key with three zero top bits starts in the first eighth at any size
+static str clustered_key(size_t i, bool absent, uint64_t *seed) {
+  (void)i;
+  char buf[32];
+  for (;;) {
+    int n = snprintf(buf, sizeof(buf), "%c%llx", absent ? 'd' : 'c',
+                     (unsigned long long)next_rand(seed));
+    uint64_t x = hash_bytes((unsigned char *)buf, n) * 11400714819323198485ull;
+    if (x >> 61 == 0) {
+      return copy_key(buf, n);
+    }
+  }
+}
+
+typedef str (*key_fn)(size_t i, bool absent, uint64_t *seed);
+
+typedef struct {
+  const char *name;
+  key_fn make;
+  size_t max;
+} key_set;
+
+static const key_set SETS[] = {
+    {"stations", station_key, SIZE_MAX},
+    {"prefixed", prefixed_key, SIZE_MAX},
+    {"numeric", numeric_key, SIZE_MAX},
+    {"clustered", clustered_key, CLUSTER_MAX},
+};
+
+// n present keys and n absent ones from the same set
+static str *make_keys(const key_set *set, size_t n) {
+  str *keys = malloc(2 * n * sizeof(str));
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  for (size_t i = 0; i < 2 * n; i++) {
+    keys[i] = set->make(i, i >= n, &seed);
+  }
+  return keys;
+}
+
+static void run(const key_set *set, size_t n, uint32_t *order) {
+  str *keys = make_keys(set, n);
+  str *absent = keys + n;
+  size_t lookups = set->max == SIZE_MAX ? LOOKUPS : CLUSTER_LOOKUPS;
+  uint64_t seed = 0x2545f4914f6cdd1dULL;
+  for (size_t i = 0; i < lookups; i++) {
+    order[i] = (uint32_t)(next_rand(&seed) % n);
+  }
+
+  ht *t = ht_create();
+  size_t resizes = 0;
+  double load = 0;
+  double slowest = 0;
+  double start = now();
+  for (size_t i = 0; i < n; i++) {
+    size_t cap = ht_capacity(t);
+    double before = now();
+    if (ht_insert(t, keys[i], keys + i) != 0) {
+      fprintf(stderr, "insert failed at %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+    double took = now() - before;
+    if (ht_capacity(t) != cap) {
+      resizes++;
+      // the load the table held when it decided to grow
+      load = cap ? (double)i / cap : 0;
+      slowest = took > slowest ? took : slowest;
+    }
+  }
+  double insert = now() - start;
+
+  start = now();
+  size_t sink = 0;
+  for (size_t i = 0; i < lookups; i++) {
+    sink += ht_search(t, keys[order[i]]) != NULL;
+  }
+  double hit = now() - start;
+
+  start = now();
+  for (size_t i = 0; i < lookups; i++) {
+    sink += ht_search(t, absent[order[i]]) != NULL;
+  }
+  double miss = now() - start;
+
+  ht_shape shape;
+  ht_stats(t, &shape);
+  char at[16] = "    -";
+  if (resizes) {
+    snprintf(at, sizeof(at), "%5.3f", load);
+  }
+  fprintf(stdout,
+          "%8zu %-9s %7.1f %7.1f %7.1f %7.2f %6zu %s %3zu %8.3f %6.1f%s\n",
+          n, set->name, insert * 1e9 / n, hit * 1e9 / lookups,
+          miss * 1e9 / lookups, shape.avg_probe, shape.max_probe, at,
+          resizes, slowest * 1e3, (double)shape.bytes / shape.count,
+          sink == lookups ? "" : " (lookup mismatch)");
+
+  ht_destroy(&t);
+  for (size_t i = 0; i < 2 * n; i++) {
+    free(keys[i].data);
+  }
+  free(keys);
+}
+
+int main(void) {
+  size_t sizes[] = {100, 10000, 1000000};
+  uint32_t *order = malloc(LOOKUPS * sizeof(uint32_t));
+  if (order == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stdout,
+          "    keys set        ins ns  hit ns miss ns   probe    max  load"
+          " rsz  slow ms  B/key\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t k = 0; k < sizeof(SETS) / sizeof(SETS[0]); k++) {
+      if (sizes[s] <= SETS[k].max) {
+        run(&SETS[k], sizes[s], order);
+      }
+    }
+  }
+  free(order);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/*
+
+  what huge pages buy: the same buffer from huge_alloc with the layer on
+  and with it off, then random 8 byte reads all over it and a sequential
+  sum through it, each reported as ns per access and, where the kernel
+  lets perf count them, dTLB load misses per access.
+
+  how much of the buffer actually got huge pages is read back from
+  AnonHugePages in /proc/self/smaps_rollup. with no pages reserved in
+  /proc/sys/vm/nr_hugepages and transparent huge pages set to never,
+  both runs are 4 KB paged and should look the same.
+
+    bench_tlb [MB]
+
+*/
+#define _GNU_SOURCE // syscall and clock_gettime on glibc
+
+#include "huge.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define READS (32 * 1000 * 1000)
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// dTLB read misses of this thread, -1 when perf won't count them
+static int dtlb_open(void) {
+#if defined(__linux__)
+  struct perf_event_attr attr = {0};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static uint64_t dtlb_read(int fd) {
+  uint64_t v = 0;
+  if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v)) {
+    return 0;
+  }
+  return v;
+}
+
+// kB of anonymous memory on huge pages in the whole process
+static long anon_huge_kb(void) {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (f == NULL) {
+    return -1;
+  }
+  char line[256];
+  long kb = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+static void report(const char *what, double took, uint64_t misses, int fd,
+                   size_t n) {
+  fprintf(stdout, "  %-10s %7.2f ns/access", what, took * 1e9 / n);
+  if (fd >= 0) {
+    fprintf(stdout, "  %8.4f dtlb misses/access", (double)misses / n);
+  }
+  fputc('\n', stdout);
+}
+
+static void run(const char *name, size_t size, int fd) {
+  long before = anon_huge_kb();
+  uint64_t *buf = huge_alloc(size);
+  if (buf == NULL) {
+    fprintf(stderr, "failed to allocate %zu bytes\n", size);
+    exit(EXIT_FAILURE);
+  }
+  size_t words = size / sizeof(uint64_t);
+  // fault every page in before anything is timed
+  for (size_t i = 0; i < words; i++) {
+    buf[i] = i;
+  }
+  long huge = anon_huge_kb();
+  fprintf(stdout, "%s: %zu MB, %ld MB on huge pages\n", name, size >> 20,
+          huge >= 0 && before >= 0 ? (huge - before) >> 10 : -1);
+
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  uint64_t sink = 0;
+  uint64_t m = dtlb_read(fd);
+  double start = now();
+  for (size_t i = 0; i < READS; i++) {
+    sink += buf[next_rand(&seed) % words];
+  }
+  report("random", now() - start, dtlb_read(fd) - m, fd, READS);
+
+  m = dtlb_read(fd);
+  start = now();
+  for (size_t i = 0; i < words; i++) {
+    sink += buf[i];
+  }
+  report("sequential", now() - start, dtlb_read(fd) - m, fd, words);
+
+  huge_free(buf, size);
+  if (sink == 42) {
+    fputc('\n', stdout);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+  if (mb == 0) {
+    fprintf(stderr, "usage: %s [MB]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t size = mb << 20;
+
+  int fd = dtlb_open();
+  if (fd < 0) {
+    fputs("dtlb misses can't be counted here, timing only\n", stdout);
+  }
+  run("huge pages", size, fd);
+  huge_disable();
+  run("4 KB pages", size, fd);
+  if (fd >= 0) {
+    close(fd);
+  }
+  return EXIT_SUCCESS;
+}
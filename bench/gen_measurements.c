@@ -0,0 +1,128 @@
+/*
+
+  writes a deterministic measurements file, one name;temp row per line.
+
+  usage: gen_measurements <out> [rows] [stations] [names] [seed]
+    rows      rows to write, default 1000000
+    stations  distinct stations, 10 to 10000, default 413
+    names     name length distribution, default mixed
+                short  3 to 10 bytes
+                mixed  mostly 5 to 12 bytes with a tail up to 40, like 1brc
+                long   20 to 100 bytes, the limit of the spec
+    seed      default 1
+
+  every station gets a mean temperature and rows scatter around it,
+  clamped to -99.9..99.9, the same file comes out for the same arguments.
+
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_CAP 101
+
+typedef struct {
+  char name[NAME_CAP];
+  int len;
+  int mean; // tenths
+} station;
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static int pick_len(const char *dist, uint64_t *seed) {
+  if (strcmp(dist, "short") == 0) {
+    return 3 + (int)(next_rand(seed) % 8);
+  } else if (strcmp(dist, "long") == 0) {
+    return 20 + (int)(next_rand(seed) % 81);
+  }
+  if (next_rand(seed) % 100 < 90) {
+    return 5 + (int)(next_rand(seed) % 8);
+  }
+  return 13 + (int)(next_rand(seed) % 28);
+}
+
+// capitalised letters with the odd space, a '-' and the index in base 26.
+// the random part never holds a '-', so names are unique whatever it came
+// out as
+static void make_name(station *s, size_t index, int len, uint64_t *seed) {
+  char suffix[8];
+  int n = 0;
+  do {
+    suffix[n++] = 'a' + index % 26;
+    index /= 26;
+  } while (index);
+
+  int body = len > n + 1 ? len - n - 1 : 1;
+  for (int i = 0; i < body; i++) {
+    char c = 'a' + next_rand(seed) % 26;
+    if (i == 0) {
+      c = 'A' + next_rand(seed) % 26;
+    } else if (i > 1 && i < body - 1 && next_rand(seed) % 9 == 0 &&
+               s->name[i - 1] != ' ') {
+      c = ' ';
+    }
+    s->name[i] = c;
+  }
+  s->name[body] = '-';
+  memcpy(s->name + body + 1, suffix, n);
+  s->len = body + 1 + n;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <out> [rows] [stations] [short|mixed|long] [seed]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *path = argv[1];
+  long long rows = argc > 2 ? atoll(argv[2]) : 1000000;
+  long stations = argc > 3 ? atol(argv[3]) : 413;
+  const char *dist = argc > 4 ? argv[4] : "mixed";
+  uint64_t seed = argc > 5 ? strtoull(argv[5], NULL, 10) : 1;
+  if (rows < 0 || stations < 10 || stations > 10000) {
+    fputs("rows must be >= 0 and stations within 10..10000\n", stderr);
+    return EXIT_FAILURE;
+  }
+  // xorshift never leaves zero
+  seed = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+  station *s = calloc(stations, sizeof(station));
+  if (s == NULL) {
+    return EXIT_FAILURE;
+  }
+  for (long i = 0; i < stations; i++) {
+    make_name(&s[i], (size_t)i, pick_len(dist, &seed), &seed);
+    s[i].mean = (int)(next_rand(&seed) % 600) - 200;
+  }
+
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror("Failed to open output.");
+    free(s);
+    return EXIT_FAILURE;
+  }
+  static char buf[1 << 20];
+  setvbuf(f, buf, _IOFBF, sizeof(buf));
+
+  for (long long r = 0; r < rows; r++) {
+    station *st = &s[next_rand(&seed) % stations];
+    // triangular noise of +-25.0 around the mean
+    int noise = (int)(next_rand(&seed) % 251) + (int)(next_rand(&seed) % 251) - 250;
+    int t = st->mean + noise;
+    t = t < -999 ? -999 : t > 999 ? 999 : t;
+    int a = t < 0 ? -t : t;
+    fprintf(f, "%.*s;%s%d.%d\n", st->len, st->name, t < 0 ? "-" : "", a / 10,
+            a % 10);
+  }
+
+  int err = fclose(f) != 0;
+  free(s);
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
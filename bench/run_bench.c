@@ -0,0 +1,143 @@
+/*
+
+  times a driver over an input file.
+
+  usage: run_bench <reps> <input> <binary> [args...]
+
+  runs `binary args... input` reps times with stdout discarded, after one
+  untimed warm up run, and reports median, p95 and min wall time, rows/s
+  and GB/s at the median, and the peak rss over all runs.
+
+*/
+#define _DEFAULT_SOURCE // wait4
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// rows are lines, counted once up front
+static long long count_rows(const char *path, long long *bytes) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  static char buf[1 << 20];
+  long long rows = 0;
+  *bytes = 0;
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    *bytes += n;
+    for (char *p = buf; (p = memchr(p, '\n', buf + n - p)); p++) {
+      rows++;
+    }
+  }
+  fclose(f);
+  return rows;
+}
+
+// runs the command once, non-zero if it failed
+static int run_once(char **cmd, double *wall, long *peak_kb) {
+  double start = now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    return 1;
+  } else if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+      dup2(null, STDOUT_FILENO);
+    }
+    execv(cmd[0], cmd);
+    _exit(127);
+  }
+
+  int status;
+  struct rusage ru;
+  if (wait4(pid, &status, 0, &ru) < 0) {
+    return 1;
+  }
+  *wall = now() - start;
+#ifdef __APPLE__
+  long kb = ru.ru_maxrss / 1024; // bytes on macos
+#else
+  long kb = ru.ru_maxrss;
+#endif
+  *peak_kb = kb > *peak_kb ? kb : *peak_kb;
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s <reps> <input> <binary> [args...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int reps = atoi(argv[1]);
+  const char *input = argv[2];
+  if (reps < 1) {
+    reps = 1;
+  }
+
+  long long bytes = 0;
+  long long rows = count_rows(input, &bytes);
+  if (rows < 0) {
+    perror("Failed to read input.");
+    return EXIT_FAILURE;
+  }
+
+  // binary, its args, the input and the terminating null
+  int n_args = argc - 3;
+  char **cmd = calloc(n_args + 2, sizeof(char *));
+  double *walls = calloc(reps, sizeof(double));
+  if (cmd == NULL || walls == NULL) {
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < n_args; i++) {
+    cmd[i] = argv[3 + i];
+  }
+  cmd[n_args] = (char *)input;
+
+  long peak_kb = 0;
+  double warm;
+  if (run_once(cmd, &warm, &peak_kb) != 0) {
+    fprintf(stderr, "%s failed\n", cmd[0]);
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < reps; i++) {
+    if (run_once(cmd, &walls[i], &peak_kb) != 0) {
+      fprintf(stderr, "%s failed\n", cmd[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  qsort(walls, reps, sizeof(double), cmp_double);
+  double median = walls[reps / 2];
+  double p95 = walls[(int)((reps - 1) * 0.95 + 0.5)];
+  fprintf(stdout,
+          "%-24s median %8.3f s  p95 %8.3f s  min %8.3f s  "
+          "%7.1f Mrows/s  %6.2f GB/s  peak rss %7.1f MB\n",
+          cmd[0], median, p95, walls[0], rows / median * 1e-6,
+          bytes / median * 1e-9, peak_kb / 1024.0);
+
+  free(walls);
+  free(cmd);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+
+  bump allocator, memory is carved from large blocks and only ever given
+  back all at once by arena_destroy.
+
+  not thread safe, the intent is one arena per table or per worker so
+  threads never meet in the allocator.
+
+*/
+typedef struct arena arena;
+
+// blocks of block_size bytes, 0 for the default
+arena *arena_create(size_t block_size);
+
+// frees every block and changes the ptr to null
+// non-zero return on error
+int arena_destroy(arena **a);
+
+// size bytes aligned to align (a power of two), null on failure
+// allocations larger than a block get a block of their own
+void *arena_alloc(arena *a, size_t size, size_t align);
+
+// copies n bytes into the arena, null on failure
+void *arena_copy(arena *a, const void *src, size_t n);
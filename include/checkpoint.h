@@ -0,0 +1,47 @@
+#pragma once
+
+#include "q_strings.h"
+#include "stats_table.h"
+#include <stdint.h>
+
+/*
+
+  persisted aggregates of an append only input.
+
+  a checkpoint holds the station table of the first offset bytes of a
+  file together with enough to tell whether the file still starts with
+  those bytes: its device and inode, and hashes of the first and of the
+  last CKPT_BLOCK bytes before offset. if all of them match, only what
+  was appended since has to be parsed. anything else, a rotated or
+  rewritten or truncated file, means a full scan.
+
+  the file is a fixed header, then per station its key length, min, max,
+  sum and count followed by the key bytes, then a hash of everything
+  before it. it is written to a temporary next to it and renamed over the
+  old one, so a crash leaves the previous checkpoint intact.
+
+*/
+
+#define CKPT_BLOCK 4096
+
+typedef struct {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t offset; // bytes covered, always just past a \n
+  uint64_t head;   // hash of the block at the start
+  uint64_t tail;   // hash of the block ending at offset
+} ckpt_ident;
+
+// identity of path whose first data.len bytes are data, non-zero on error
+int ckpt_identify(const char *path, str data, ckpt_ident *out);
+
+// whether path, currently mapped as data, still starts with what saved
+// covered, so parsing can resume at saved->offset
+bool ckpt_matches(const ckpt_ident *saved, const char *path, str data);
+
+// writes table and id to path, non-zero on error
+int ckpt_save(const char *path, const ckpt_ident *id, stats_table *table);
+
+// adds the saved stations into table and fills id, non-zero if there is
+// no checkpoint at path or it is damaged, table may be partly filled then
+int ckpt_load(const char *path, ckpt_ident *id, stats_table *table);
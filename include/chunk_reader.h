@@ -0,0 +1,41 @@
+#pragma once
+
+#include "q_strings.h"
+#include <stddef.h>
+
+/*
+
+  streams a file descriptor in newline aligned chunks.
+
+  a dedicated io thread fills a ring of buffers with read() while the
+  callers parse the chunks it already handed out, so reading overlaps
+  parsing and the input never has to fit in memory. works on pipes.
+  the partial line at the end of each buffer is carried over to the start
+  of the next one, a final line without \n gets one appended.
+
+  reader_next and reader_release are safe to call from many threads.
+
+*/
+typedef struct chunk_reader chunk_reader;
+
+typedef struct {
+  str data;
+
+  // PRIVATE
+  int _slot;
+} chunk;
+
+// nbufs buffers of buf_size bytes, a line may not be longer than buf_size
+// returns null on error, the caller still owns fd
+chunk_reader *reader_create(int fd, size_t buf_size, int nbufs);
+
+// blocks until a chunk is ready
+// false once the input is exhausted or the io thread failed
+bool reader_next(chunk_reader *r, chunk *out);
+
+// hands the chunk's buffer back to the io thread for refilling
+void reader_release(chunk_reader *r, chunk c);
+
+// stops the io thread and frees the buffers
+// non-zero if reading failed or a line did not fit in a buffer
+int reader_destroy(chunk_reader **r);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "q_strings.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+
+  gzip input decompressed by many threads at once.
+
+  a gzip file can be any number of members back to back, each with its
+  own header, deflate stream and crc. bgzip and concatenated gzip outputs
+  (cat a.gz b.gz) write many, plain gzip and pigz write one. the members
+  are independent, so the compressed bytes are cut into parts and every
+  member belongs to the part its header starts in.
+
+  member headers can't be told from compressed bytes by looking, so a
+  part's first member is the first 1f 8b 08 in it that inflates without
+  error to the end of a member with its crc and length matching, or for
+  GZ_OUT bytes of output. that inflate goes on as the member's real one,
+  no member is inflated twice. the others are found by inflating. the
+  part before stops exactly there, it keeps going until a member starts
+  at or past its end. a one member file is inflated by the first part
+  alone.
+
+  rows straddle member and part boundaries. a part hands whole lines to
+  its callback as it inflates and returns what came before its first \n
+  and after its last one, gz_stitch joins those of neighbouring parts.
+
+*/
+
+// decompressed bytes handed to the callback at a time, at most
+#define GZ_OUT (4 * 1024 * 1024)
+
+typedef struct {
+  const unsigned char *data;
+  size_t len;
+
+  // PRIVATE
+  void *_map;
+} gz_file;
+
+// whether path starts like a gzip file, false if it can't be read
+bool gz_sniff(const char *path);
+
+// maps path read only, non-zero on error or if it is not gzip
+int gz_open(const char *path, gz_file *f);
+
+void gz_close(gz_file *f);
+
+// what a part leaves for its neighbours
+typedef struct {
+  str head;     // before the first \n, or everything if there is none
+  str tail;     // after the last \n
+  bool newline; // the part had a \n
+  uint64_t members;
+  uint64_t bytes; // decompressed
+} gz_part;
+
+// called with whole lines, each ending in \n, non-zero stops the part
+typedef int (*gz_lines_fn)(void *ctx, str lines);
+
+// inflates the members starting in [from, to), non-zero on a damaged
+// member or when fn fails. out's strs are malloc'd, see gz_part_free
+int gz_inflate_part(const gz_file *f, size_t from, size_t to, gz_lines_fn fn,
+                    void *ctx, gz_part *out);
+
+void gz_part_free(gz_part *p);
+
+// hands the lines that straddle the n parts, in order, to fn
+// non-zero on error
+int gz_stitch(const gz_part *parts, size_t n, gz_lines_fn fn, void *ctx);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+
+  word at a time hash in the style of wyhash.
+
+  the key is consumed 8 bytes at a time, each word folded in with a
+  64x64->128 multiply whose halves are xored together. a key of n bytes
+  is n / 8 full words followed by one zero padded word of the remaining
+  n % 8 bytes (possibly none), then the length. that split lets a scanner
+  that is already loading words to look for a delimiter build the same
+  hash as it goes, see cut_hash in q_strings.h.
+
+*/
+
+#define HASH_SEED 0x2d358dccaa6c78a5ULL
+#define HASH_K0 0x8bb84b93962eacc9ULL
+#define HASH_K1 0x4b33a62ed433d4a3ULL
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+// folds one (possibly partial, zero padded) word into the running hash
+static inline uint64_t hash_word(uint64_t h, uint64_t word) {
+  return hash_mix(word ^ HASH_K0, h ^ HASH_K1);
+}
+
+static inline uint64_t hash_finish(uint64_t h, size_t len) {
+  return hash_mix(h ^ len, HASH_K0);
+}
+
+static inline uint64_t hash_bytes(const unsigned char *p, ptrdiff_t n) {
+  uint64_t h = HASH_SEED;
+  ptrdiff_t i = 0;
+  for (; n - i >= 8; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    h = hash_word(h, w);
+  }
+  uint64_t w = 0;
+  memcpy(&w, p + i, n - i);
+  return hash_finish(hash_word(h, w), (size_t)n);
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "arena.h"
 #include "q_strings.h"
 #include <stddef.h>
 
@@ -8,6 +9,12 @@ typedef struct ht ht;
 // allocate the ht on the heap
 ht *ht_create(void);
 
+// same as ht_create but key copies are carved from keys instead of being
+// malloc'd one by one. the arena must outlive the table, destroying the
+// table leaves the keys for arena_destroy to free in one go. values can
+// come from the same arena with arena_alloc
+ht *ht_create_in(arena *keys);
+
 // frees the table and changes the ptr to null
 // non-zero return on error
 int ht_destroy(ht **table);
@@ -19,18 +26,48 @@ void *ht_search(ht *table, str key);
 // 2^53 max entries
 int ht_insert(ht *table, str key, void *value);
 
-// non-zero error
+// removes key and frees the table's copy of it, the value is untouched
+// non-zero error, 1 if the key was not in the table
 int ht_remove(ht *table, str key);
 
-// typedef struct {
-//   void *value;
-//   str *key;
-//
-//   // PRIVATE
-//   ht *_table;
-//   size_t _index;
-// } ht_iter;
-//
-// ht_iter ht_iterator(ht *table);
-//
-// ht_iter ht_next(ht_iter iterator);
+// number of keys in the table
+size_t ht_count(ht *table);
+
+// number of slots, the table grows before it is half full
+size_t ht_capacity(ht *table);
+
+// how the keys sit in the slots, for benchmarks and tuning
+typedef struct {
+  size_t count;
+  size_t cap;
+  double avg_probe; // slots a search for a present key looks at
+  size_t max_probe;
+  size_t bytes; // table, slots and key bytes, not malloc's overhead
+} ht_shape;
+
+// one pass over every slot, non-zero on error
+int ht_stats(ht *table, ht_shape *out);
+
+// walks the occupied entries in slot order, key is null when done
+//   for (ht_iter it = ht_iterator(t); it.key; it = ht_next(it))
+// inserting or removing while iterating invalidates the iterator
+typedef struct {
+  void *value;
+  str *key;
+
+  // PRIVATE
+  ht *_table;
+  size_t _index;
+} ht_iter;
+
+ht_iter ht_iterator(ht *table);
+
+ht_iter ht_next(ht_iter iterator);
+
+// returns the value to keep when both tables hold a key
+typedef void *(*ht_combine_fn)(void *dst_value, void *src_value);
+
+// folds every entry of src into dst in one pass over src, reusing the
+// hashes src already has. keys only in src are copied with their value
+// non-zero on error
+int ht_merge(ht *dst, ht *src, ht_combine_fn combine);
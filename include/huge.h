@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+
+  zeroed allocations backed by 2 MB pages where the system allows.
+
+  a scan over gigabytes of buffers and slot arrays with 4 KB pages spends
+  a real share of its time walking page tables. from HUGE_MIN bytes up an
+  allocation is mmap'd with MAP_HUGETLB, which needs pages reserved in
+  /proc/sys/vm/nr_hugepages, and failing that as a 2 MB aligned anonymous
+  mapping that is madvise'd for transparent huge pages. smaller ones come
+  from the normal heap.
+
+  HUGE_PAGES=off in the environment, or huge_disable(), turns it off:
+  allocations from HUGE_MIN up are then still mmap'd, but madvise'd to
+  stay on 4 KB pages even where the system would promote them. memory
+  from huge_alloc must go back through huge_free with the same size, the
+  size alone tells the heap and the mmap paths apart.
+
+*/
+
+#define HUGE_PAGE ((size_t)2 * 1024 * 1024)
+
+// below this a huge page would mostly be waste
+#define HUGE_MIN (HUGE_PAGE / 2)
+
+// zeroed, 64 byte aligned at least, null on failure
+void *huge_alloc(size_t size);
+
+void huge_free(void *p, size_t size);
+
+// asks for transparent huge pages on an existing mapping, a hint only
+void huge_advise(void *p, size_t len);
+
+// switches the layer off for every later huge_alloc, before any threads
+void huge_disable(void);
+
+// false once disabled, by huge_disable or the environment
+bool huge_enabled(void);
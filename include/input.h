@@ -0,0 +1,35 @@
+#pragma once
+
+#include "q_strings.h"
+#include <stddef.h>
+
+/*
+
+  the whole input as newline terminated bytes.
+
+  regular files are mmap'd read only and data points straight into the
+  mapping. a final line without a \n can't be fixed up in place, so it is
+  copied out into tail with the \n appended. pipes and anything that can't
+  be mapped are read into a heap buffer instead, tail is empty then.
+
+*/
+typedef struct {
+  str data;
+  str tail;
+
+  // PRIVATE
+  void *_map;
+  size_t _map_len;
+  unsigned char *_owned;
+} input;
+
+// non-zero on error, in is zeroed on failure
+int input_open(const char *path, input *in);
+
+// input_open, optionally without asking the kernel to start reading the
+// whole file right away. pages a cold file has to read are then placed
+// on the node of the thread that first touches them, not the caller's
+int input_open_with(const char *path, input *in, bool prefetch);
+
+// unmaps or frees whatever input_open acquired
+void input_close(input *in);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "q_strings.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*
+
+  hands out small newline aligned pieces (morsels) of an in memory input
+  to any number of threads from one atomic cursor.
+
+  threads that finish early simply claim more, so a slow core only holds
+  up the end of the run by one morsel instead of a whole static share.
+  the cursor moves in fixed byte steps, each claimed range owns the lines
+  that start inside it, so claims never overlap and never skip a line.
+
+*/
+typedef struct {
+  str input;
+  ptrdiff_t size;
+
+  // PRIVATE
+  _Atomic ptrdiff_t _cursor;
+} morsel_queue;
+
+// input must end in \n, size is the target morsel length in bytes
+void morsel_init(morsel_queue *q, str input, ptrdiff_t size);
+
+// claims the next morsel, false once the input is exhausted
+// a morsel can be empty when a single line spans the whole step
+bool morsel_next(morsel_queue *q, str *out);
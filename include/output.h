@@ -0,0 +1,31 @@
+#pragma once
+
+#include "q_strings.h"
+#include "stats_table.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+
+  final stage: the table as {name=min/mean/max, ...}\n in byte order.
+
+  the names are sorted once with a multikey quicksort, which compares a
+  byte at a time and never looks at a shared prefix twice, and the tenths
+  are formatted by hand into one buffer sized up front, so the whole
+  result costs a single allocation and a single write.
+
+*/
+
+// writes v tenths as [-]d.d to out, returns the bytes written
+// out needs room for 21 bytes
+ptrdiff_t format_tenths(unsigned char *out, int64_t v);
+
+// sorts slots by key bytes, shorter keys before their extensions
+void sort_slots(st_slot **slots, size_t n);
+
+// the formatted result, data is malloc'd and owned by the caller
+// an invalid str on error
+str format_results(stats_table *table);
+
+// formats table and writes it to fd, non-zero on error
+int write_results(int fd, stats_table *table);
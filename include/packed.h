@@ -0,0 +1,94 @@
+#pragma once
+
+#include "q_strings.h"
+#include "stats_table.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+
+  measurements pre-encoded for repeat scans.
+
+  parsing the text is most of a run's time and the same file is often
+  aggregated again and again. a packed file holds every row as a station
+  id and a temperature in tenths, two bytes each, so a scan is a walk
+  over two arrays that sums into a dense per station array, no splitting,
+  no number parsing and no hashing.
+
+  the layout, native byte order:
+  - a 64 byte header: magic, rows, blocks, stations, where the dictionary
+    starts and how long it is, rows per block
+  - the blocks, back to back from byte 64. a block is its row count, the
+    lowest and highest temperature in it, then rows ids as uint16_t and
+    rows temperatures as int16_t. every block but the last holds
+    PACK_BLOCK_ROWS rows, so block i starts at a fixed offset
+  - the dictionary, for every id in order its name's length as uint32_t
+    followed by the name
+
+  ids are 16 bits, a file holds at most PACK_MAX_STATIONS stations.
+
+*/
+
+#define PACK_BLOCK_ROWS 65536
+#define PACK_MAX_STATIONS 65536
+
+/*
+
+  writes a packed file from rows handed to it one at a time, to a
+  temporary next to path that pack_finish renames into place
+
+*/
+typedef struct pack_writer pack_writer;
+
+// null on error
+pack_writer *pack_create(const char *path);
+
+// adds one row, 1 once the dictionary is full, non-zero on any error
+int pack_add(pack_writer *w, str name, int16_t temp);
+
+// writes the dictionary and header, moves the file into place and frees w
+// non-zero on error, the temporary is removed then
+int pack_finish(pack_writer **w);
+
+// removes the temporary and frees w
+void pack_discard(pack_writer **w);
+
+// a packed file mapped read only
+typedef struct {
+  uint64_t rows;
+  size_t blocks;
+  size_t stations;
+  str *names; // indexed by id, pointing into the mapping
+
+  // PRIVATE
+  const unsigned char *_map;
+  size_t _map_len;
+  size_t _block_rows;
+} pack_file;
+
+// maps and checks path, non-zero if it is missing or not a packed file
+// f is zeroed on failure
+int pack_open(const char *path, pack_file *f);
+
+void pack_close(pack_file *f);
+
+// one station's aggregates, min and max start out inverted
+typedef struct {
+  int64_t sum;
+  int64_t count;
+  int16_t min;
+  int16_t max;
+} pack_stat;
+
+// a dense array for n stations, free it with free()
+pack_stat *pack_stats_create(size_t n);
+
+// adds block b into stats, the rows it held or -1 if it is damaged
+int64_t pack_aggregate(const pack_file *f, size_t b, pack_stat *stats);
+
+// folds src into dst, both n long
+void pack_stats_merge(pack_stat *dst, const pack_stat *src, size_t n);
+
+// adds every station that has rows in stats to dst by name
+// non-zero on error
+int pack_export(const pack_file *f, const pack_stat *stats, stats_table *dst);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+
+  the input files named on a command line.
+
+  an argument that is a directory stands for the regular files directly
+  in it, in byte order of their names, skipping hidden ones. one holding
+  *, ? or [ that is not an existing path is a glob pattern, expanded
+  with glob(3) for shells that left it quoted, to the regular files it
+  matches. anything else is taken as it is, whether it exists or not, so
+  opening it reports the error.
+
+*/
+typedef struct {
+  char **paths;
+  size_t count;
+} path_list;
+
+// non-zero on error, including a pattern or directory with no files
+// out is empty on failure
+int path_list_expand(char **args, size_t n, path_list *out);
+
+void path_list_free(path_list *l);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+
+  opt in per phase and per thread timing.
+
+  a span accumulates wall time, and optionally hardware counters, over
+  any number of begin/end pairs on one thread. counters come from
+  perf_event_open on the calling thread only, user space only, so every
+  thread that wants them opens its own set. when perf is unavailable
+  (no permission, a container, not linux) spans still get wall time and
+  the report says the counters are missing.
+
+*/
+
+#define PROF_EVENTS 4
+
+typedef enum {
+  PROF_CYCLES,
+  PROF_INSTRUCTIONS,
+  PROF_CACHE_MISSES,
+  PROF_BRANCH_MISSES,
+} prof_event;
+
+typedef enum { PROF_OFF, PROF_TEXT, PROF_JSON } prof_format;
+
+typedef struct {
+  prof_format format;
+  bool counters;
+} prof_config;
+
+// one thread's counters, fd is -1 for a counter that is not open
+typedef struct {
+  int fd[PROF_EVENTS];
+} prof_counters;
+
+// a point in time on one thread
+typedef struct {
+  double wall;
+  uint64_t events[PROF_EVENTS];
+} prof_sample;
+
+typedef struct {
+  double wall;
+  uint64_t events[PROF_EVENTS];
+  bool counted; // events are valid
+} prof_span;
+
+// parses "text", "json" or "counters" joined by ',', e.g. "json,counters"
+// an empty spec is text, non-zero on anything else
+int prof_parse(const char *spec, prof_config *config);
+
+// opens the calling thread's counters if enabled, a no-op otherwise
+// returns non-zero if they were asked for and could not be opened
+int prof_open(prof_counters *c, bool enabled);
+
+void prof_close(prof_counters *c);
+
+// wall time, and the counters that are open, right now
+prof_sample prof_now(const prof_counters *c);
+
+// adds the time and events between from and to to s
+void prof_add(prof_span *s, const prof_counters *c, prof_sample from,
+              prof_sample to);
+
+// folds b into a, events only stay counted if both were
+void prof_sum(prof_span *a, const prof_span *b);
+
+typedef struct {
+  const char *name;
+  prof_span span;
+} prof_phase;
+
+/*
+
+  writes the phases and one line per thread to out, as a table or one
+  json object as config says. rows[i] is what thread i processed, rows
+  can be null. a table notes missing counters if they were asked for
+
+*/
+void prof_report(FILE *out, prof_config config, const prof_phase *phases,
+                 size_t n_phases, const prof_span *threads,
+                 const int64_t *rows, size_t n_threads);
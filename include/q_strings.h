@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #define S(s) ((str){.data = (unsigned char *)s, .len = sizeof(s) - 1})
@@ -22,6 +23,41 @@ str slice(unsigned char *start, unsigned char *end);
 // returns a snip, splitting s on first instance of c
 snip cut(str s, char c);
 
+// cut that also returns hash_bytes of the head in *hash, the key is
+// hashed from the same words that are searched for c
+snip cut_hash(str s, char c, uint64_t *hash);
+
+// index of the first c in p[0..n), n if there is none
+// scans 32 (avx2), 16 (sse2) or 8 (swar) bytes at a time
+ptrdiff_t find_byte(const unsigned char *p, ptrdiff_t n, unsigned char c);
+
+// bit i set when byte i of the block is that delimiter
+typedef struct {
+  uint64_t semi;
+  uint64_t nl;
+} delims;
+
+#define DELIM_BLOCK 64
+
+// finds every ; and \n in the first DELIM_BLOCK bytes of s
+// bytes past s.len never set a bit
+delims scan_delims(str s);
+
 bool are_equal(str a, str b);
 
 bool is_valid_str(str a);
+
+/*
+
+  parses a -?\d{1,2}\.\d temperature at the start of s into tenths of a
+  degree without branches, *len is set to the length of the number.
+  anything else in that position gives garbage, the caller validates.
+
+*/
+int16_t parse_tenths(str s, ptrdiff_t *len);
+
+// parse_tenths for a caller that knows 8 bytes at p are readable
+int16_t parse_tenths_at(const unsigned char *p, ptrdiff_t *len);
+
+// mean of count tenths summing to sum, rounded half up, in tenths
+int64_t mean_tenths(int64_t sum, int64_t count);
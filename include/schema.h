@@ -0,0 +1,138 @@
+#pragma once
+
+#include "q_strings.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+
+  row parser specialised at build time for the feed's schema:
+  name;temp\n with a name of 1 to SCHEMA_NAME_MAX bytes and a temperature
+  of one decimal place between SCHEMA_TEMP_MIN and SCHEMA_TEMP_MAX tenths.
+  override any of them with -D, e.g. -DSCHEMA_NAME_MAX=32.
+
+  away from the end of a buffer a row is at most SCHEMA_ROW_MAX bytes, so
+  the fast path scans a name and loads the number without a single bounds
+  check, then validates the number, the \n and the range with one branch.
+  a row that fails that goes through the generic path, which checks every
+  byte and is also what rows near the end of a buffer use. a name holding
+  a \n, a row missing its ';' that ran into the next one, sends the row
+  there too. -DSCHEMA_GENERIC builds without the fast path.
+
+*/
+
+#ifndef SCHEMA_NAME_MAX
+#define SCHEMA_NAME_MAX 100
+#endif
+
+#ifndef SCHEMA_TEMP_MIN
+#define SCHEMA_TEMP_MIN (-999)
+#endif
+
+#ifndef SCHEMA_TEMP_MAX
+#define SCHEMA_TEMP_MAX 999
+#endif
+
+// name, ';', "-99.9" and '\n'
+#define SCHEMA_ROW_MAX (SCHEMA_NAME_MAX + 7)
+
+static_assert(SCHEMA_NAME_MAX > 0, "names are at least one byte");
+static_assert(SCHEMA_TEMP_MIN >= -999 && SCHEMA_TEMP_MAX <= 999 &&
+                  SCHEMA_TEMP_MIN <= SCHEMA_TEMP_MAX,
+              "parse_tenths reads at most two integer digits");
+
+typedef struct {
+  str name;
+  uint64_t hash; // hash_bytes of name
+  int16_t temp;  // tenths
+} row;
+
+/*
+
+  every byte checked, consumes one row from the start of rest.
+  returns its length including the \n, 0 if the row is malformed
+
+*/
+static inline ptrdiff_t parse_row_checked(str rest, row *r) {
+  snip n = cut_hash(rest, ';', &r->hash);
+  if (!n.ok || n.head.len == 0 || n.head.len > SCHEMA_NAME_MAX ||
+      find_byte(n.head.data, n.head.len, '\n') != n.head.len) {
+    return 0;
+  }
+
+  const unsigned char *p = n.tail.data;
+  const unsigned char *end = p + n.tail.len;
+  int sign = 1;
+  if (p < end && *p == '-') {
+    sign = -1;
+    p++;
+  }
+  int v = 0;
+  int digits = 0;
+  for (; p < end && *p >= '0' && *p <= '9' && digits < 2; ++p, ++digits) {
+    v = v * 10 + (*p - '0');
+  }
+  if (digits == 0 || end - p < 3 || p[0] != '.' || p[1] < '0' || p[1] > '9' ||
+      p[2] != '\n') {
+    return 0;
+  }
+  v = sign * (v * 10 + (p[1] - '0'));
+  if (v < SCHEMA_TEMP_MIN || v > SCHEMA_TEMP_MAX) {
+    return 0;
+  }
+
+  r->name = n.head;
+  r->temp = (int16_t)v;
+  return p + 3 - rest.data;
+}
+
+/*
+
+  the 3 to 5 bytes of a number, starting at p and with its '.' at byte
+  dot / 8, are one of X.X XX.X -X.X -XX.X. the '.' and a '-' are checked
+  in place, every other byte is overwritten with '0' and then all 8 must
+  be digits: high nibble 3 and low nibble at most 9
+
+*/
+static inline bool _schema_number_ok(uint64_t word, ptrdiff_t len, int dot) {
+  uint64_t in = ~0ULL >> (64 - 8 * len);
+  uint64_t neg = (word & 0xFF) == '-' ? 0xFF : 0;
+  uint64_t fixed = (0xFFULL << dot) | neg;
+  uint64_t want = ((uint64_t)'.' << dot) | (neg & '-');
+  uint64_t x = (word & in & ~fixed) | (0x3030303030303030ULL & (fixed | ~in));
+  // one or two digits between the optional '-' and the '.'
+  int digits = (dot >> 3) - (neg != 0);
+  return (word & fixed) == want && (digits == 1 || digits == 2) &&
+         (x & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL &&
+         (((x & 0x0F0F0F0F0F0F0F0FULL) + 0x0606060606060606ULL) &
+          0xF0F0F0F0F0F0F0F0ULL) == 0;
+}
+
+// parse_row_checked, with the schema taken as given wherever it can be
+static inline ptrdiff_t parse_row(str rest, row *r) {
+#ifndef SCHEMA_GENERIC
+  // room for the longest row plus the 8 byte load at its number
+  if (rest.len >= SCHEMA_ROW_MAX + 8) {
+    snip n = cut_hash(slice(rest.data, rest.data + SCHEMA_NAME_MAX + 1), ';',
+                      &r->hash);
+    const unsigned char *p = n.tail.data;
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    uint64_t dots = ~word & 0x10101000ULL;
+    if (n.ok && n.head.len > 0 && dots) {
+      ptrdiff_t len;
+      int16_t temp = parse_tenths_at(p, &len);
+      int dot = __builtin_ctzll(dots) - 4;
+      if (p[len] == '\n' && _schema_number_ok(word, len, dot) &&
+          temp >= SCHEMA_TEMP_MIN && temp <= SCHEMA_TEMP_MAX &&
+          find_byte(n.head.data, n.head.len, '\n') == n.head.len) {
+        r->name = n.head;
+        r->temp = temp;
+        return p + len + 1 - rest.data;
+      }
+    }
+  }
+#endif
+  return parse_row_checked(rest, r);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "q_strings.h"
+#include "stats_table.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+
+  immutable copies of a stats table for readers that must never wait.
+
+  a snapshot is built from the table an ingesting thread keeps updating
+  and is never written again: its own table for lookups by name, the
+  slots sorted by name for prefix ranges, by mean and by max for top k,
+  and the whole result already formatted.
+
+  a snap_pub holds the current snapshot. readers take it with
+  snap_acquire, which announces it in the reader's hazard slot, and give
+  it back with snap_release. the one writer swaps in a new snapshot with
+  snap_publish and frees the ones it replaced once no hazard slot names
+  them. a reader never takes a lock and the writer never waits for one.
+
+*/
+
+typedef struct {
+  stats_table *table;
+  st_slot **by_name;
+  st_slot **by_mean; // highest first, ties by name
+  st_slot **by_max;  // highest first, ties by name
+  size_t count;
+  str dump; // {name=min/mean/max, ...}\n
+  uint64_t rows;
+  uint64_t generation;
+} snapshot;
+
+// a copy of table, null on error
+snapshot *snap_build(stats_table *table, uint64_t rows, uint64_t generation);
+
+// frees the snapshot and changes the ptr to null
+void snap_free(snapshot **s);
+
+// the station called name, null if there is none
+st_slot *snap_get(const snapshot *s, str name);
+
+// stations starting with prefix are by_name[*first..*first + n), returns n
+size_t snap_prefix(const snapshot *s, str prefix, size_t *first);
+
+// most readers that can hold a snapshot at once
+#define SNAP_READERS 64
+
+typedef struct {
+  _Atomic(snapshot *) current;
+  _Atomic(snapshot *) hazard[SNAP_READERS];
+
+  // PRIVATE, the writer's
+  snapshot *_retired[SNAP_READERS + 1];
+  size_t _n_retired;
+} snap_pub;
+
+void snap_pub_init(snap_pub *p);
+
+// frees every snapshot, no reader may hold one
+void snap_pub_destroy(snap_pub *p);
+
+// the current snapshot, valid until snap_release by the same reader
+// reader is in [0, SNAP_READERS) and used by one thread at a time
+snapshot *snap_acquire(snap_pub *p, size_t reader);
+
+void snap_release(snap_pub *p, size_t reader);
+
+// makes s current, only ever called from one thread
+void snap_publish(snap_pub *p, snapshot *s);
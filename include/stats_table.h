@@ -0,0 +1,103 @@
+#pragma once
+
+#include "q_strings.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+
+  open addressing table specialised for station aggregates.
+
+  unlike ht, a slot holds everything a row touches: the cached hash, the
+  key and the min/max/sum/count in tenths. keys up to ST_INLINE_KEY bytes
+  live inside the slot, longer ones are copied to an arena owned by the
+  table. a slot is one cache line, so a hit costs a single line and no
+  pointer chasing, and the cached hash makes growing and merging free of
+  rehashing.
+
+*/
+
+#define ST_INLINE_KEY 32
+
+typedef struct {
+  uint64_t hash;
+  int64_t sum;
+  int64_t count;
+  int16_t min;
+  int16_t max;
+  uint32_t len; // 0 for an empty slot
+  union {
+    unsigned char key[ST_INLINE_KEY];
+    unsigned char *ext;
+  };
+} st_slot;
+
+typedef struct stats_table stats_table;
+
+// room for at least cap_hint keys before the first grow
+stats_table *st_create(size_t cap_hint);
+
+// frees the table and its keys, changes the ptr to null
+// non-zero return on error
+int st_destroy(stats_table **table);
+
+// hash used for the slots, hash_bytes from hash.h, so a key hashed by
+// cut_hash while it was scanned can go straight to st_add_hashed
+uint64_t st_hash(str key);
+
+// adds one temperature to key, creating the slot if needed
+// non-zero on error
+int st_add(stats_table *table, str key, int16_t temp);
+
+// same as st_add with the hash of key already computed
+int st_add_hashed(stats_table *table, str key, uint64_t hash, int16_t temp);
+
+// returns null if not found, or missuse
+st_slot *st_search(stats_table *table, str key);
+
+// number of keys in the table
+size_t st_count(const stats_table *table);
+
+// the key stored in a slot
+str st_key(st_slot *slot);
+
+// walks the occupied slots, start with *i = 0, null when done
+st_slot *st_next(stats_table *table, size_t *i);
+
+// folds one slot, of any table, into dst using its cached hash
+// non-zero on error
+int st_merge_slot(stats_table *dst, st_slot *slot);
+
+// folds every slot of src into dst using the cached hashes
+// non-zero on error
+int st_merge(stats_table *dst, stats_table *src);
+
+/*
+
+  shared variant for many threads aggregating into one table.
+
+  slots are claimed with a cas on their state and stats are updated with
+  atomic adds, nothing ever locks. the price is a fixed capacity, sized
+  up front from the most keys expected, and contended lines when threads
+  hit the same station. the alternative to private tables plus a merge
+  when there are too many stations for every thread to hold them all.
+
+*/
+
+#define SST_INLINE_KEY 24
+
+typedef struct shared_stats shared_stats;
+
+// room for max_keys keys, the table never grows
+shared_stats *sst_create(size_t max_keys);
+
+// not safe while other threads still add, changes the ptr to null
+// non-zero return on error
+int sst_destroy(shared_stats **table);
+
+// thread safe st_add_hashed, non-zero on error or once the table is full
+int sst_add_hashed(shared_stats *table, str key, uint64_t hash, int16_t temp);
+
+// folds every key into dst, call once the adding threads are done
+// non-zero on error
+int sst_export(shared_stats *table, stats_table *dst);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+
+  which cpus this process may run on and the numa node of each, read
+  from /sys/devices/system/node. cpus are listed node by node, so giving
+  worker i the i-th cpu puts consecutive workers on the same node and
+  consecutive slices of the input with them.
+
+  machines without the sysfs tree, or with one node, load as a single
+  node of every cpu the affinity mask allows.
+
+*/
+typedef struct {
+  size_t count;
+  int *cpus;     // node by node, ascending within a node
+  int *nodes;    // node of cpus[i]
+  int node_count;
+} topology;
+
+// non-zero on error, t is zeroed on failure
+int topology_load(topology *t);
+
+void topology_free(topology *t);
+
+// makes threads created with attr start on cpu, non-zero on error
+int topology_pin(pthread_attr_t *attr, int cpu);
@@ -0,0 +1,106 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_BLOCK (1 << 20)
+
+typedef struct arena_block arena_block;
+struct arena_block {
+  arena_block *next;
+  size_t used;
+  size_t cap;
+  alignas(max_align_t) unsigned char data[];
+};
+
+struct arena {
+  arena_block *head;
+  size_t block_size;
+};
+
+arena *arena_create(size_t block_size) {
+  arena *a = malloc(sizeof(arena));
+  if (a == NULL) {
+    return NULL;
+  }
+  a->head = NULL;
+  a->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+  return a;
+}
+
+int arena_destroy(arena **a) {
+  if (a == NULL || *a == NULL) {
+    return 1;
+  }
+  arena_block *b = (*a)->head;
+  while (b) {
+    arena_block *next = b->next;
+    free(b);
+    b = next;
+  }
+  free(*a);
+  *a = NULL;
+  return 0;
+}
+
+static arena_block *_arena_grow(arena *a, size_t need) {
+  size_t cap = need > a->block_size ? need : a->block_size;
+  if (cap > SIZE_MAX - sizeof(arena_block)) {
+    return NULL;
+  }
+  arena_block *b = malloc(sizeof(arena_block) + cap);
+  if (b == NULL) {
+    return NULL;
+  }
+  b->used = 0;
+  b->cap = cap;
+  if (need > a->block_size && a->head) {
+    // an oversized block goes behind the current one so the current
+    // block's free space isn't abandoned
+    b->next = a->head->next;
+    a->head->next = b;
+  } else {
+    b->next = a->head;
+    a->head = b;
+  }
+  return b;
+}
+
+void *arena_alloc(arena *a, size_t size, size_t align) {
+  if (a == NULL || align == 0 || (align & (align - 1)) != 0) {
+    return NULL;
+  }
+
+  arena_block *b = a->head;
+  if (b) {
+    uintptr_t base = (uintptr_t)b->data;
+    uintptr_t at = (base + b->used + (align - 1)) & ~(uintptr_t)(align - 1);
+    size_t off = at - base;
+    if (off <= b->cap && b->cap - off >= size) {
+      b->used = off + size;
+      return b->data + off;
+    }
+  }
+
+  // fresh blocks are max_align_t aligned, pad for anything stricter
+  size_t need = size + (align > alignof(max_align_t) ? align : 0);
+  if (need < size) {
+    return NULL;
+  }
+  b = _arena_grow(a, need);
+  if (b == NULL) {
+    return NULL;
+  }
+  uintptr_t base = (uintptr_t)b->data;
+  uintptr_t at = (base + (align - 1)) & ~(uintptr_t)(align - 1);
+  b->used = (at - base) + size;
+  return b->data + (at - base);
+}
+
+void *arena_copy(arena *a, const void *src, size_t n) {
+  void *p = arena_alloc(a, n, 1);
+  if (p && n) {
+    memcpy(p, src, n);
+  }
+  return p;
+}
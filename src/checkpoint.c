@@ -0,0 +1,180 @@
+#include "checkpoint.h"
+#include "hash.h"
+#include "schema.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char CKPT_MAGIC[8] = {'B', 'R', 'C', 'C', 'K', 'P', 'T', '1'};
+
+// the header as it sits on disk, native byte order
+typedef struct {
+  char magic[8];
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t offset;
+  uint64_t head;
+  uint64_t tail;
+  uint64_t stations;
+} ckpt_header;
+
+typedef struct {
+  uint32_t len;
+  int16_t min;
+  int16_t max;
+  int64_t sum;
+  int64_t count;
+} ckpt_record;
+
+static_assert(sizeof(ckpt_record) == 24, "records are written as they are");
+
+static void _ckpt_blocks(str data, uint64_t offset, ckpt_ident *out) {
+  uint64_t n = offset < CKPT_BLOCK ? offset : CKPT_BLOCK;
+  out->offset = offset;
+  out->head = hash_bytes(data.data, n);
+  out->tail = hash_bytes(data.data + offset - n, n);
+}
+
+int ckpt_identify(const char *path, str data, ckpt_ident *out) {
+  struct stat st;
+  if (path == NULL || out == NULL || data.len < 0 || stat(path, &st) != 0) {
+    return 1;
+  }
+  out->dev = st.st_dev;
+  out->ino = st.st_ino;
+  _ckpt_blocks(data, data.len, out);
+  return 0;
+}
+
+bool ckpt_matches(const ckpt_ident *saved, const char *path, str data) {
+  ckpt_ident now;
+  if (saved == NULL || data.len < 0 || (uint64_t)data.len < saved->offset ||
+      ckpt_identify(path, data, &now) != 0) {
+    return false;
+  }
+  _ckpt_blocks(data, saved->offset, &now);
+  return now.dev == saved->dev && now.ino == saved->ino &&
+         now.head == saved->head && now.tail == saved->tail;
+}
+
+// fwrite that also folds what it writes into *h
+static bool _ckpt_put(FILE *f, const void *p, size_t n, uint64_t *h) {
+  *h = hash_word(*h, hash_bytes(p, n));
+  return fwrite(p, 1, n, f) == n;
+}
+
+int ckpt_save(const char *path, const ckpt_ident *id, stats_table *table) {
+  if (path == NULL || id == NULL || table == NULL) {
+    return 2;
+  }
+  size_t len = strlen(path);
+  char *tmp = malloc(len + 5);
+  if (tmp == NULL) {
+    return 1;
+  }
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".tmp", 5);
+
+  FILE *f = fopen(tmp, "wb");
+  if (f == NULL) {
+    free(tmp);
+    return 1;
+  }
+  ckpt_header h = {
+      .dev = id->dev,
+      .ino = id->ino,
+      .offset = id->offset,
+      .head = id->head,
+      .tail = id->tail,
+      .stations = st_count(table),
+  };
+  memcpy(h.magic, CKPT_MAGIC, sizeof(h.magic));
+
+  uint64_t sum = HASH_SEED;
+  bool ok = _ckpt_put(f, &h, sizeof(h), &sum);
+  size_t i = 0;
+  st_slot *s;
+  while (ok && (s = st_next(table, &i))) {
+    str key = st_key(s);
+    ckpt_record r = {.len = s->len,
+                     .min = s->min,
+                     .max = s->max,
+                     .sum = s->sum,
+                     .count = s->count};
+    ok = _ckpt_put(f, &r, sizeof(r), &sum) &&
+         _ckpt_put(f, key.data, key.len, &sum);
+  }
+  ok = ok && fwrite(&sum, sizeof(sum), 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) {
+    remove(tmp);
+  }
+  free(tmp);
+  return !ok;
+}
+
+// fread that also folds what it reads into *h
+static bool _ckpt_get(FILE *f, void *p, size_t n, uint64_t *h) {
+  if (fread(p, 1, n, f) != n) {
+    return false;
+  }
+  *h = hash_word(*h, hash_bytes(p, n));
+  return true;
+}
+
+int ckpt_load(const char *path, ckpt_ident *id, stats_table *table) {
+  if (path == NULL || id == NULL || table == NULL) {
+    return 2;
+  }
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return 1;
+  }
+
+  uint64_t sum = HASH_SEED;
+  ckpt_header h;
+  bool ok = _ckpt_get(f, &h, sizeof(h), &sum) &&
+            memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) == 0;
+  // records are not verified until the trailing sum, a length no parsed
+  // name can have is refused before anything is read for it
+  unsigned char key[SCHEMA_NAME_MAX];
+  for (uint64_t n = 0; ok && n < h.stations; ++n) {
+    ckpt_record r;
+    ok = _ckpt_get(f, &r, sizeof(r), &sum) && r.len > 0 &&
+         r.len <= SCHEMA_NAME_MAX && r.count > 0 &&
+         _ckpt_get(f, key, r.len, &sum);
+    if (!ok) {
+      break;
+    }
+
+    str k = {.data = key, .len = r.len};
+    st_slot slot = {.hash = st_hash(k),
+                    .sum = r.sum,
+                    .count = r.count,
+                    .min = r.min,
+                    .max = r.max,
+                    .len = r.len};
+    if (r.len > ST_INLINE_KEY) {
+      slot.ext = key;
+    } else {
+      memcpy(slot.key, key, r.len);
+    }
+    ok = st_merge_slot(table, &slot) == 0;
+  }
+  uint64_t stored;
+  ok = ok && fread(&stored, sizeof(stored), 1, f) == 1 && stored == sum &&
+       fgetc(f) == EOF;
+  fclose(f);
+
+  if (ok) {
+    *id = (ckpt_ident){.dev = h.dev,
+                       .ino = h.ino,
+                       .offset = h.offset,
+                       .head = h.head,
+                       .tail = h.tail};
+  }
+  return !ok;
+}
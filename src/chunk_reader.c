@@ -0,0 +1,225 @@
+#include "chunk_reader.h"
+#include "huge.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+enum { SLOT_FREE, SLOT_READY, SLOT_BUSY };
+
+typedef struct {
+  unsigned char *buf;
+  ptrdiff_t len;
+  int state;
+} slot;
+
+struct chunk_reader {
+  int fd;
+  size_t buf_size;
+  int nbufs;
+  slot *slots;
+
+  // partial line carried from one buffer to the next
+  unsigned char *carry;
+  size_t carry_len;
+
+  pthread_t io;
+  pthread_mutex_t lock;
+  pthread_cond_t has_free;
+  pthread_cond_t has_ready;
+  bool done;
+  bool stop;
+  int err;
+};
+
+// index of a slot in state, -1 if none
+static int _reader_find(chunk_reader *r, int state) {
+  for (int i = 0; i < r->nbufs; i++) {
+    if (r->slots[i].state == state) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// fill buf after the carry, returns bytes in buf or -1 on error
+static ptrdiff_t _reader_fill(chunk_reader *r, unsigned char *buf) {
+  memcpy(buf, r->carry, r->carry_len);
+  size_t len = r->carry_len;
+  while (len < r->buf_size) {
+    ssize_t got = read(r->fd, buf + len, r->buf_size - len);
+    if (got < 0) {
+      return -1;
+    } else if (got == 0) {
+      break;
+    }
+    len += (size_t)got;
+  }
+  return (ptrdiff_t)len;
+}
+
+// io thread, owns the carry and fills free slots until eof
+static void *_reader_run(void *arg) {
+  chunk_reader *r = arg;
+  int err = 0;
+  bool eof = false;
+
+  while (!eof) {
+    pthread_mutex_lock(&r->lock);
+    int i;
+    while ((i = _reader_find(r, SLOT_FREE)) < 0 && !r->stop) {
+      pthread_cond_wait(&r->has_free, &r->lock);
+    }
+    bool stop = r->stop;
+    pthread_mutex_unlock(&r->lock);
+    if (stop) {
+      break;
+    }
+
+    // the slot is ours until it is marked ready, no lock needed to fill it
+    slot *s = &r->slots[i];
+    ptrdiff_t len = _reader_fill(r, s->buf);
+    if (len < 0) {
+      err = 1;
+      break;
+    }
+    eof = (size_t)len < r->buf_size;
+
+    // cut after the last \n, the rest waits for the next buffer
+    ptrdiff_t end = len;
+    while (end > 0 && s->buf[end - 1] != '\n') {
+      end--;
+    }
+    if (eof && end < len) {
+      // last line has no \n, there is always room for one at eof
+      s->buf[len++] = '\n';
+      end = len;
+    } else if (end == 0 && len > 0) {
+      // a whole buffer without a \n, the line can never fit
+      err = 1;
+      break;
+    }
+    r->carry_len = (size_t)(len - end);
+    memcpy(r->carry, s->buf + end, r->carry_len);
+
+    pthread_mutex_lock(&r->lock);
+    s->len = end;
+    s->state = end ? SLOT_READY : SLOT_FREE;
+    pthread_cond_broadcast(&r->has_ready);
+    pthread_mutex_unlock(&r->lock);
+  }
+
+  pthread_mutex_lock(&r->lock);
+  r->err = err;
+  r->done = true;
+  pthread_cond_broadcast(&r->has_ready);
+  pthread_mutex_unlock(&r->lock);
+  return NULL;
+}
+
+chunk_reader *reader_create(int fd, size_t buf_size, int nbufs) {
+  if (fd < 0 || buf_size == 0 || nbufs < 2) {
+    return NULL;
+  }
+
+  chunk_reader *r = calloc(1, sizeof(chunk_reader));
+  if (r == NULL) {
+    return NULL;
+  }
+  r->fd = fd;
+  r->buf_size = buf_size;
+  r->nbufs = nbufs;
+  r->slots = calloc(nbufs, sizeof(slot));
+  r->carry = malloc(buf_size);
+  if (r->slots == NULL || r->carry == NULL) {
+    goto fail;
+  }
+  for (int i = 0; i < nbufs; i++) {
+    // one spare byte for the \n appended at eof
+    r->slots[i].buf = huge_alloc(buf_size + 1);
+    if (r->slots[i].buf == NULL) {
+      goto fail;
+    }
+  }
+
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->has_free, NULL);
+  pthread_cond_init(&r->has_ready, NULL);
+  if (pthread_create(&r->io, NULL, _reader_run, r) != 0) {
+    pthread_cond_destroy(&r->has_ready);
+    pthread_cond_destroy(&r->has_free);
+    pthread_mutex_destroy(&r->lock);
+    goto fail;
+  }
+  return r;
+
+fail:
+  if (r->slots) {
+    for (int i = 0; i < nbufs; i++) {
+      huge_free(r->slots[i].buf, buf_size + 1);
+    }
+  }
+  free(r->slots);
+  free(r->carry);
+  free(r);
+  return NULL;
+}
+
+bool reader_next(chunk_reader *r, chunk *out) {
+  if (r == NULL || out == NULL) {
+    return false;
+  }
+
+  pthread_mutex_lock(&r->lock);
+  int i;
+  while ((i = _reader_find(r, SLOT_READY)) < 0 && !r->done) {
+    pthread_cond_wait(&r->has_ready, &r->lock);
+  }
+  if (i >= 0 && !r->err) {
+    r->slots[i].state = SLOT_BUSY;
+  }
+  bool ok = i >= 0 && !r->err;
+  pthread_mutex_unlock(&r->lock);
+
+  if (!ok) {
+    return false;
+  }
+  slot *s = &r->slots[i];
+  *out = (chunk){.data = slice(s->buf, s->buf + s->len), ._slot = i};
+  return true;
+}
+
+void reader_release(chunk_reader *r, chunk c) {
+  if (r == NULL || c._slot < 0 || c._slot >= r->nbufs) {
+    return;
+  }
+  pthread_mutex_lock(&r->lock);
+  r->slots[c._slot].state = SLOT_FREE;
+  pthread_cond_signal(&r->has_free);
+  pthread_mutex_unlock(&r->lock);
+}
+
+int reader_destroy(chunk_reader **reader) {
+  if (reader == NULL || *reader == NULL) {
+    return 1;
+  }
+  chunk_reader *r = *reader;
+
+  pthread_mutex_lock(&r->lock);
+  r->stop = true;
+  pthread_cond_broadcast(&r->has_free);
+  pthread_mutex_unlock(&r->lock);
+  pthread_join(r->io, NULL);
+
+  int err = r->err;
+  for (int i = 0; i < r->nbufs; i++) {
+    huge_free(r->slots[i].buf, r->buf_size + 1);
+  }
+  pthread_cond_destroy(&r->has_ready);
+  pthread_cond_destroy(&r->has_free);
+  pthread_mutex_destroy(&r->lock);
+  free(r->slots);
+  free(r->carry);
+  free(r);
+  *reader = NULL;
+  return err;
+}
@@ -0,0 +1,326 @@
+#define _GNU_SOURCE // madvise on glibc
+
+#include "gz_input.h"
+#include "huge.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// 1f 8b, deflate, and no reserved flag bits
+static inline bool _gz_header_at(const gz_file *f, size_t at) {
+  return at + 10 <= f->len && f->data[at] == 0x1f && f->data[at + 1] == 0x8b &&
+         f->data[at + 2] == 8 && (f->data[at + 3] & 0xe0) == 0;
+}
+
+bool gz_sniff(const char *path) {
+  unsigned char magic[3];
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool gz = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+            magic[0] == 0x1f && magic[1] == 0x8b && magic[2] == 8;
+  close(fd);
+  return gz;
+}
+
+int gz_open(const char *path, gz_file *f) {
+  if (path == NULL || f == NULL) {
+    return 1;
+  }
+  *f = (gz_file){0};
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 10) {
+    close(fd);
+    return 1;
+  }
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return 1;
+  }
+  // hints only, failure is harmless
+  madvise(map, len, MADV_WILLNEED);
+  huge_advise(map, len);
+  *f = (gz_file){.data = map, .len = len, ._map = map};
+  if (!_gz_header_at(f, 0)) {
+    gz_close(f);
+    return 1;
+  }
+  return 0;
+}
+
+void gz_close(gz_file *f) {
+  if (f == NULL) {
+    return;
+  }
+  if (f->_map) {
+    munmap(f->_map, f->len);
+  }
+  *f = (gz_file){0};
+}
+
+// gives zlib as much of the input from at as its 32 bit counter allows
+static inline void _gz_feed(z_stream *z, const gz_file *f, size_t at) {
+  size_t left = f->len - at;
+  z->next_in = (unsigned char *)f->data + at;
+  z->avail_in = left > UINT_MAX ? UINT_MAX : (unsigned)left;
+}
+
+// where in the file zlib has read up to
+static inline size_t _gz_pos(const z_stream *z, const gz_file *f) {
+  return (size_t)(z->next_in - f->data);
+}
+
+static unsigned char *_gz_copy(const unsigned char *p, size_t n) {
+  unsigned char *c = malloc(n ? n : 1);
+  if (c) {
+    memcpy(c, p, n);
+  }
+  return c;
+}
+
+typedef struct {
+  unsigned char *buf;
+  size_t cap;
+  size_t used;
+} gz_buffer;
+
+// passes the whole lines in b on, keeps the rest at its front. the first
+// \n of the part ends its head
+static int _gz_emit(gz_buffer *b, gz_part *out, gz_lines_fn fn, void *ctx) {
+  size_t end = b->used;
+  while (end && b->buf[end - 1] != '\n') {
+    end--;
+  }
+  if (end == 0) {
+    return 0;
+  }
+  size_t from = 0;
+  if (!out->newline) {
+    from = (size_t)find_byte(b->buf, (ptrdiff_t)end, '\n');
+    out->head.data = _gz_copy(b->buf, from);
+    if (out->head.data == NULL) {
+      return 1;
+    }
+    out->head.len = (ptrdiff_t)from;
+    out->newline = true;
+    from++;
+  }
+  if (end > from && fn(ctx, slice(b->buf + from, b->buf + end)) != 0) {
+    return 1;
+  }
+  memmove(b->buf, b->buf + end, b->used - end);
+  b->used -= end;
+  return 0;
+}
+
+// room for more output, a line longer than the buffer grows it
+static int _gz_make_room(gz_buffer *b, gz_part *out, gz_lines_fn fn,
+                         void *ctx) {
+  if (b->used < b->cap) {
+    return 0;
+  }
+  if (_gz_emit(b, out, fn, ctx) != 0) {
+    return 1;
+  }
+  if (b->used == b->cap) {
+    unsigned char *n = realloc(b->buf, b->cap * 2);
+    if (n == NULL) {
+      return 1;
+    }
+    b->buf = n;
+    b->cap *= 2;
+  }
+  return 0;
+}
+
+/*
+
+  starts inflating a member whose header may be at at into the empty b,
+  nothing is handed on yet. true if it inflates cleanly to the end of the
+  member, crc and length included, or until b is full. the member then
+  carries on from where z stopped, so the check costs no second inflate.
+  *ret is what the last inflate returned
+
+*/
+static bool _gz_try_member(z_stream *z, const gz_file *f, size_t at,
+                           gz_buffer *b, int *ret) {
+  if (!_gz_header_at(f, at) || inflateReset(z) != Z_OK) {
+    return false;
+  }
+  _gz_feed(z, f, at);
+  b->used = 0;
+  while (b->used < b->cap) {
+    z->next_out = b->buf + b->used;
+    z->avail_out = (unsigned)(b->cap - b->used);
+    *ret = inflate(z, Z_NO_FLUSH);
+    b->used = b->cap - z->avail_out;
+    if (*ret == Z_STREAM_END) {
+      return true;
+    } else if (*ret != Z_OK) {
+      return false;
+    } else if (z->avail_in == 0) {
+      size_t pos = _gz_pos(z, f);
+      if (pos == f->len) {
+        return false;
+      }
+      _gz_feed(z, f, pos);
+    }
+  }
+  return true;
+}
+
+// the first member starting in [from, to), to if there is none. it is
+// left started in z and b, see _gz_try_member
+static size_t _gz_first_member(z_stream *z, const gz_file *f, size_t from,
+                               size_t to, gz_buffer *b, int *ret) {
+  for (size_t at = from; at < to; ++at) {
+    const unsigned char *p = memchr(f->data + at, 0x1f, to - at);
+    if (p == NULL) {
+      break;
+    }
+    at = (size_t)(p - f->data);
+    if (_gz_try_member(z, f, at, b, ret)) {
+      return at;
+    }
+  }
+  b->used = 0;
+  return to;
+}
+
+int gz_inflate_part(const gz_file *f, size_t from, size_t to, gz_lines_fn fn,
+                    void *ctx, gz_part *out) {
+  if (f == NULL || fn == NULL || out == NULL) {
+    return 2;
+  }
+  *out = (gz_part){0};
+  to = to < f->len ? to : f->len;
+
+  z_stream z = {0};
+  if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+    return 1;
+  }
+  gz_buffer b = {.buf = malloc(GZ_OUT), .cap = GZ_OUT};
+  int err = b.buf == NULL;
+
+  // the first part's first member is at 0 and needs no search
+  int ret = Z_OK;
+  size_t at = err ? to : from;
+  bool started = false; // z is already partway into the member at at
+  if (!err && from > 0) {
+    at = _gz_first_member(&z, f, from, to, &b, &ret);
+    started = at < to;
+    out->bytes += b.used;
+  }
+  while (!err && at < to && (started || _gz_header_at(f, at))) {
+    if (!started) {
+      err = inflateReset(&z) != Z_OK;
+      _gz_feed(&z, f, at);
+      ret = Z_OK;
+    }
+    started = false;
+    while (!err && ret != Z_STREAM_END) {
+      err = _gz_make_room(&b, out, fn, ctx);
+      z.next_out = b.buf + b.used;
+      z.avail_out = (unsigned)(b.cap - b.used);
+      ret = err ? Z_OK : inflate(&z, Z_NO_FLUSH);
+      size_t got = b.cap - b.used - z.avail_out;
+      b.used += got;
+      out->bytes += got;
+      if (ret != Z_OK && ret != Z_STREAM_END) {
+        err = 1;
+      } else if (ret == Z_OK && z.avail_in == 0) {
+        // a member cut short by the end of the file is an error too
+        size_t pos = _gz_pos(&z, f);
+        err = pos == f->len;
+        _gz_feed(&z, f, pos);
+      }
+    }
+    out->members += !err;
+    at = _gz_pos(&z, f);
+  }
+  // anything after the last member that is not a header, zero padding
+  // mostly, is ignored like gzip -d does
+
+  if (!err) {
+    err = _gz_emit(&b, out, fn, ctx);
+  }
+  if (!err) {
+    str *rest = out->newline ? &out->tail : &out->head;
+    rest->data = _gz_copy(b.buf, b.used);
+    rest->len = (ptrdiff_t)b.used;
+    err = rest->data == NULL;
+  }
+  inflateEnd(&z);
+  free(b.buf);
+  if (err) {
+    gz_part_free(out);
+  }
+  return err;
+}
+
+void gz_part_free(gz_part *p) {
+  if (p == NULL) {
+    return;
+  }
+  free(p->head.data);
+  free(p->tail.data);
+  p->head = p->tail = (str){0};
+}
+
+// appends n bytes to a growing line, non-zero on error
+static int _gz_append(gz_buffer *line, str s) {
+  if (line->used + s.len > line->cap) {
+    size_t cap = (line->used + s.len) * 2;
+    unsigned char *n = realloc(line->buf, cap);
+    if (n == NULL) {
+      return 1;
+    }
+    line->buf = n;
+    line->cap = cap;
+  }
+  if (s.len) {
+    memcpy(line->buf + line->used, s.data, s.len);
+  }
+  line->used += s.len;
+  return 0;
+}
+
+// the line built so far, with its \n, to fn. nothing for an empty one
+static int _gz_flush(gz_buffer *line, gz_lines_fn fn, void *ctx) {
+  if (line->used == 0) {
+    return 0;
+  }
+  if (_gz_append(line, S("\n")) != 0 ||
+      fn(ctx, slice(line->buf, line->buf + line->used)) != 0) {
+    return 1;
+  }
+  line->used = 0;
+  return 0;
+}
+
+int gz_stitch(const gz_part *parts, size_t n, gz_lines_fn fn, void *ctx) {
+  gz_buffer line = {0};
+  int err = 0;
+  for (size_t i = 0; i < n && !err; ++i) {
+    err = _gz_append(&line, parts[i].head);
+    if (!err && parts[i].newline) {
+      err = _gz_flush(&line, fn, ctx) || _gz_append(&line, parts[i].tail);
+    }
+  }
+  // the last line of the file, if it has no \n
+  err = err || _gz_flush(&line, fn, ctx);
+  free(line.buf);
+  return err;
+}
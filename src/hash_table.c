@@ -1,4 +1,6 @@
 #include "hash_table.h"
+#include "hash.h"
+#include "huge.h"
 #include "q_strings.h"
 #include <float.h>
 #include <stddef.h>
@@ -8,9 +10,11 @@
 
 const int HT_MAGIC = 0xDEADDEAD;
 
+// the hash is kept so growing, removing and merging never rehash a key
 typedef struct {
   str key;
   void *value;
+  uint64_t hash;
 } ht_entry;
 
 struct ht {
@@ -18,41 +22,21 @@ struct ht {
   ht_entry *array;
   size_t cap;
   size_t elements;
+  arena *keys; // null when every key is malloc'd on its own
 };
 
-/*
-all values are uint64 except the byte_to_be_hashed
-which is uint8
-fnv1 prime number: 0x100000001b3
-fnv offset bias: 0xcbf29ce484222325
-hash = hash_offset_bias
-for each byte_of_data to be hashed:
-  hash := hash xor byte of data
-  hash := hash * fnv prime
-return hash
-*/
-
-const uint64_t FNV_OFFSET = 14695981039346656037ULL;
-const uint64_t FNV_PRIME = 1099511628211ULL;
-
-// use clang builtins to check if overflow
-// growth rate of 1.5x to enable reuse of old data blocks
+// capacity is always a power of two so indexing is a shift and probing a
+// mask, no 64-bit division anywhere on the lookup path
 static int _ht_increase_cap(size_t old, size_t *dst) {
-  size_t half = old >> 1;
   size_t new;
 
   // will return 1 if overflow
   // stores result = result % 2^(n bits)
   // https://clang.llvm.org/docs/LanguageExtensions.html
-  if (__builtin_add_overflow(old, half, &new) != 0) {
+  if (__builtin_mul_overflow(old, (size_t)2, &new) != 0) {
     return 1;
   }
 
-  // make sure we grew
-  if (new == old) {
-    __builtin_add_overflow(old, (size_t)1, &new);
-  }
-
   // ensure floor in wraparound
   if (new < 8) {
     new = 8;
@@ -62,15 +46,8 @@ static int _ht_increase_cap(size_t old, size_t *dst) {
   return 0;
 }
 
-static uint64_t _ht_hash(str key) {
-  uint64_t hash = FNV_OFFSET;
-  for (ptrdiff_t i = 0; i < key.len; i++) {
-    // need to cast the const char* to a unsigned char
-    // (byte) then cast to uint64 to xor
-    hash ^= (uint64_t)(unsigned char)key.data[i];
-    hash *= FNV_PRIME;
-  }
-  return hash;
+static inline uint64_t _ht_hash(str key) {
+  return hash_bytes(key.data, key.len);
 }
 
 static inline bool _ht_needs_to_grow(size_t elements, size_t capacity) {
@@ -81,21 +58,23 @@ static inline int _ht_is_valid(const ht *t) {
   return t && t->magic == HT_MAGIC;
 }
 
-static uint64_t _ht_index(uint64_t hash, size_t cap) {
-  // helps mix upper bits
+static inline uint64_t _ht_index(uint64_t hash, size_t cap) {
+  // take the top bits, they are the best mixed
   // https://en.wikipedia.org/wiki/Hash_function#Fibonacci_hashing
   uint64_t x = hash * 11400714819323198485ull;
-  return (x % cap);
+  return x >> (64 - __builtin_ctzll(cap));
 }
 
 // zero an already created entry
-// we own the key so we must free
-static int _ht_zero_entry(ht_entry *e) {
-  if (!is_valid_str(e->key) || e == NULL) {
+// we own the key so we must free, unless it lives in the table's arena
+static int _ht_zero_entry(ht *table, ht_entry *e) {
+  if (e == NULL || !is_valid_str(e->key)) {
     return 1;
   }
   e->value = NULL; // point at nothing
-  free(e->key.data);
+  if (table->keys == NULL) {
+    free(e->key.data);
+  }
   e->key.data = NULL;
   e->key.len = 0;
   return 0;
@@ -103,13 +82,13 @@ static int _ht_zero_entry(ht_entry *e) {
 
 // non-zero if error
 static int _ht_resize(ht *table, size_t new_cap) {
-  // if too big dont resize
-  if (new_cap > SIZE_MAX / 1.5) {
+  // if too big or not a power of two dont resize
+  if (new_cap > SIZE_MAX / 2 || (new_cap & (new_cap - 1)) != 0) {
     return 1;
   }
 
   // alloc space for new table
-  ht_entry *new = calloc(new_cap, sizeof(ht_entry));
+  ht_entry *new = huge_alloc(new_cap * sizeof(ht_entry));
   if (new == NULL) {
     return 1;
   }
@@ -122,7 +101,7 @@ static int _ht_resize(ht *table, size_t new_cap) {
       continue;
     }
     // not null need to reinsert
-    size_t idx = (size_t)_ht_index(_ht_hash(src->key), new_cap);
+    size_t idx = (size_t)_ht_index(src->hash, new_cap);
     for (;;) { // can inf loop through bc guaranteed to be large enough
       ht_entry *dst = &new[idx];
       if (dst->key.data == NULL) {
@@ -131,18 +110,22 @@ static int _ht_resize(ht *table, size_t new_cap) {
         break;
       }
       // not empty, probe for next empty and try again
-      idx = (idx + 1) % new_cap;
+      idx = (idx + 1) & (new_cap - 1);
     }
   }
 
   // update values then free the old allocation  
+  huge_free(old, table->cap * sizeof(ht_entry));
   table->cap = new_cap;
   table->array = new;
-  free(old);
   return 0;
 }
 
 ht *ht_create(void) {
+  return ht_create_in(NULL);
+}
+
+ht *ht_create_in(arena *keys) {
   ht *n = malloc(sizeof(ht));
   if (n == NULL) {
     return NULL;
@@ -151,8 +134,9 @@ ht *ht_create(void) {
   n->cap = 256;
   n->elements = 0;
   n->magic = HT_MAGIC;
+  n->keys = keys;
 
-  n->array = calloc(n->cap, sizeof(ht_entry));
+  n->array = huge_alloc(n->cap * sizeof(ht_entry));
   if (n->array == NULL) {
     free(n);
     return NULL;
@@ -171,9 +155,11 @@ int ht_destroy(ht **table) {
   if (!_ht_is_valid(t)) {
     return 2;
   }
-  for (size_t i = 0; i < t->cap; i++) {
-    _ht_zero_entry(&t->array[i]);
+  // arena keys go when the arena does, no need to walk the table
+  for (size_t i = 0; t->keys == NULL && i < t->cap; i++) {
+    _ht_zero_entry(t, &t->array[i]);
   }
+  huge_free(t->array, t->cap * sizeof(ht_entry));
   t->magic = 0; // poison
   free(t);
   *table = NULL;
@@ -190,30 +176,32 @@ int ht_destroy(ht **table) {
 // cell that has not yet been searched. In this case, the search returns as its
 // result that the key is not present in the dictionary
 
+// index of key's entry, or of the empty entry that ends its probe
+static size_t _ht_find(const ht *table, str key, uint64_t hash) {
+  size_t idx = _ht_index(hash, table->cap);
+  for (;;) {
+    ht_entry *e = &table->array[idx];
+    if (e->key.data == NULL ||
+        (e->hash == hash && are_equal(e->key, key))) {
+      return idx;
+    }
+    idx = (idx + 1) & (table->cap - 1);
+  }
+}
+
 // RETURNS NULL IF NOT FOUND
 void *ht_search(ht *table, str key) {
   if (!_ht_is_valid(table) || !is_valid_str(key)) {
     return NULL;
   }
 
-  uint64_t idx = _ht_index(_ht_hash(key), table->cap);
-  for (;;) {
-    ht_entry *e = &table->array[idx];
-    if (e->key.data == NULL) {
-      return NULL;
-    } else if (are_equal(e->key, key)) {
-      return e->value;
-    }
-    idx = ((idx + 1) % table->cap);
-  }
+  ht_entry *e = &table->array[_ht_find(table, key, _ht_hash(key))];
+  return e->key.data ? e->value : NULL;
 }
 
-// non-zero if failure
-int ht_insert(ht *table, str key, void *value) {
+// insert with the hash of key already known, non-zero if failure
+static int _ht_insert_hashed(ht *table, str key, uint64_t hash, void *value) {
 #define MAX_ENTRIES 9007199254740992ULL
-  if (!is_valid_str(key) || !_ht_is_valid(table)) {
-    return 2;
-  }
   // doubles cant exactly express more than 2^53
   if (table->elements >= MAX_ENTRIES || table->cap > MAX_ENTRIES) {
     return 2;
@@ -230,32 +218,146 @@ int ht_insert(ht *table, str key, void *value) {
     }
   }
 
-  uint64_t idx = _ht_index(_ht_hash(key), table->cap);
   // check for key equality, update ptr
-  for (;;) {
-    ht_entry *e = &table->array[idx];
-    if (are_equal(e->key, key)) {
-      e->value = value;
-      return 0;
-    } else if (e->key.data == NULL) {
-      e->key.data = malloc(sizeof(char) * key.len);
-      if (e->key.data == NULL) {
-        return 1;
-      }
+  ht_entry *e = &table->array[_ht_find(table, key, hash)];
+  if (e->key.data == NULL) {
+    e->key.data = table->keys ? arena_copy(table->keys, key.data, key.len)
+                              : malloc(sizeof(char) * key.len);
+    if (e->key.data == NULL) {
+      return 1;
+    }
+    if (table->keys == NULL) {
       memcpy(e->key.data, key.data, key.len);
-      e->key.len = key.len;
-      e->value = value;
-      table->elements += 1;
-      return 0;
     }
-    idx = ((idx + 1) % table->cap);
+    e->key.len = key.len;
+    e->hash = hash;
+    table->elements += 1;
+  }
+  e->value = value;
+  return 0;
+}
+
+// non-zero if failure
+int ht_insert(ht *table, str key, void *value) {
+  if (!is_valid_str(key) || !_ht_is_valid(table)) {
+    return 2;
   }
-  return 1;
+  return _ht_insert_hashed(table, key, _ht_hash(key), value);
 }
 
+/*
+
+  backward shift deletion, no tombstones.
+  after emptying a slot, walk the rest of the cluster and pull back every
+  entry whose home slot is not in (hole, entry], it would be unreachable
+  past the hole otherwise. the cluster ends up exactly as if the removed
+  key had never been inserted, so probe lengths never degrade.
+
+*/
 int ht_remove(ht *table, str key) {
   if (!is_valid_str(key) || !_ht_is_valid(table)) {
     return 2;
   }
+
+  size_t mask = table->cap - 1;
+  size_t hole = _ht_find(table, key, _ht_hash(key));
+  if (table->array[hole].key.data == NULL) {
+    // not found
+    return 1;
+  }
+  _ht_zero_entry(table, &table->array[hole]);
+  table->elements -= 1;
+
+  for (size_t j = (hole + 1) & mask; table->array[j].key.data != NULL;
+       j = (j + 1) & mask) {
+    size_t home = _ht_index(table->array[j].hash, table->cap);
+    // distance from home to j vs from the hole to j, all mod cap
+    if (((j - home) & mask) >= ((j - hole) & mask)) {
+      table->array[hole] = table->array[j];
+      table->array[j] = (ht_entry){0};
+      hole = j;
+    }
+  }
+  return 0;
+}
+
+// positions the iterator on the first occupied entry at or after index
+static ht_iter _ht_iter_from(ht *table, size_t index) {
+  for (; index < table->cap; index++) {
+    ht_entry *e = &table->array[index];
+    if (e->key.data != NULL) {
+      return (ht_iter){
+          .value = e->value, .key = &e->key, ._table = table, ._index = index};
+    }
+  }
+  return (ht_iter){._table = table, ._index = table->cap};
+}
+
+ht_iter ht_iterator(ht *table) {
+  if (!_ht_is_valid(table)) {
+    return (ht_iter){0};
+  }
+  return _ht_iter_from(table, 0);
+}
+
+ht_iter ht_next(ht_iter iterator) {
+  if (!_ht_is_valid(iterator._table) || iterator.key == NULL) {
+    return (ht_iter){0};
+  }
+  return _ht_iter_from(iterator._table, iterator._index + 1);
+}
+
+size_t ht_count(ht *table) {
+  return _ht_is_valid(table) ? table->elements : 0;
+}
+
+size_t ht_capacity(ht *table) {
+  return _ht_is_valid(table) ? table->cap : 0;
+}
+
+int ht_stats(ht *table, ht_shape *out) {
+  if (!_ht_is_valid(table) || out == NULL) {
+    return 2;
+  }
+
+  *out = (ht_shape){.count = table->elements, .cap = table->cap};
+  out->bytes = sizeof(ht) + table->cap * sizeof(ht_entry);
+  uint64_t probes = 0;
+  for (size_t i = 0; i < table->cap; i++) {
+    ht_entry *e = &table->array[i];
+    if (e->key.data == NULL) {
+      continue;
+    }
+    // a search walks from the home slot to this one
+    size_t home = _ht_index(e->hash, table->cap);
+    size_t probe = ((i - home) & (table->cap - 1)) + 1;
+    probes += probe;
+    out->max_probe = probe > out->max_probe ? probe : out->max_probe;
+    out->bytes += e->key.len;
+  }
+  out->avg_probe = out->count ? (double)probes / out->count : 0.0;
+  return 0;
+}
+
+int ht_merge(ht *dst, ht *src, ht_combine_fn combine) {
+  if (!_ht_is_valid(dst) || !_ht_is_valid(src) || combine == NULL) {
+    return 2;
+  }
+  if (dst == src) {
+    return 2;
+  }
+
+  for (size_t i = 0; i < src->cap; i++) {
+    ht_entry *s = &src->array[i];
+    if (s->key.data == NULL) {
+      continue;
+    }
+    ht_entry *d = &dst->array[_ht_find(dst, s->key, s->hash)];
+    if (d->key.data != NULL) {
+      d->value = combine(d->value, s->value);
+    } else if (_ht_insert_hashed(dst, s->key, s->hash, s->value) != 0) {
+      return 1;
+    }
+  }
   return 0;
 }
@@ -0,0 +1,112 @@
+#define _GNU_SOURCE // MAP_HUGETLB and madvise on glibc
+
+#include "huge.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// -1 until the environment has been looked at, workers allocate tables
+// concurrently so the first look can race, every racer agrees though
+static _Atomic int huge_state = -1;
+
+bool huge_enabled(void) {
+  int state = atomic_load_explicit(&huge_state, memory_order_relaxed);
+  if (state < 0) {
+    const char *env = getenv("HUGE_PAGES");
+    state = !(env && (strcmp(env, "off") == 0 || strcmp(env, "0") == 0));
+    int unset = -1;
+    atomic_compare_exchange_strong_explicit(&huge_state, &unset, state,
+                                            memory_order_relaxed,
+                                            memory_order_relaxed);
+    state = atomic_load_explicit(&huge_state, memory_order_relaxed);
+  }
+  return state;
+}
+
+void huge_disable(void) {
+  atomic_store_explicit(&huge_state, 0, memory_order_relaxed);
+}
+
+static inline size_t _huge_round(size_t size) {
+  return (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+}
+
+// an anonymous mapping of len bytes on a HUGE_PAGE boundary
+static void *_huge_map_aligned(size_t len) {
+  unsigned char *raw = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+  // trim the slack off both ends
+  uintptr_t at = ((uintptr_t)raw + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+  unsigned char *p = (unsigned char *)at;
+  if (p > raw) {
+    munmap(raw, p - raw);
+  }
+  size_t tail = raw + len + HUGE_PAGE - (p + len);
+  if (tail) {
+    munmap(p + len, tail);
+  }
+  return p;
+}
+
+void *huge_alloc(size_t size) {
+  if (size < HUGE_MIN) {
+    size_t rounded = (size + 63) & ~(size_t)63;
+    void *p = aligned_alloc(64, rounded ? rounded : 64);
+    if (p) {
+      memset(p, 0, rounded);
+    }
+    return p;
+  }
+
+  // anonymous mappings come zeroed
+  size_t len = _huge_round(size);
+  if (huge_enabled()) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      return p;
+    }
+    p = _huge_map_aligned(len);
+    if (p) {
+      huge_advise(p, len);
+    }
+    return p;
+  }
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_NOHUGEPAGE
+  // off means 4 KB pages even where the system would promote on its own
+  madvise(p, len, MADV_NOHUGEPAGE);
+#endif
+  return p;
+}
+
+void huge_free(void *p, size_t size) {
+  if (p == NULL) {
+    return;
+  }
+  if (size < HUGE_MIN) {
+    free(p);
+  } else {
+    munmap(p, _huge_round(size));
+  }
+}
+
+void huge_advise(void *p, size_t len) {
+#ifdef MADV_HUGEPAGE
+  if (huge_enabled()) {
+    madvise(p, len, MADV_HUGEPAGE);
+  }
+#else
+  (void)p;
+  (void)len;
+#endif
+}
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE // madvise on glibc
+
+#include "input.h"
+#include "huge.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_STEP (1 << 20)
+
+// index one past the last \n, 0 if there is none
+static ptrdiff_t _input_last_line_end(const unsigned char *p, ptrdiff_t len) {
+  for (ptrdiff_t i = len; i > 0; i--) {
+    if (p[i - 1] == '\n') {
+      return i;
+    }
+  }
+  return 0;
+}
+
+// read everything from fd into a heap buffer with room for a trailing \n
+static int _input_read(int fd, input *in) {
+  size_t cap = READ_STEP;
+  size_t len = 0;
+  unsigned char *buf = malloc(cap + 1);
+  if (buf == NULL) {
+    return 1;
+  }
+
+  for (;;) {
+    if (len == cap) {
+      if (cap > SIZE_MAX / 2 - 1) {
+        free(buf);
+        return 1;
+      }
+      unsigned char *n = realloc(buf, cap * 2 + 1);
+      if (n == NULL) {
+        free(buf);
+        return 1;
+      }
+      buf = n;
+      cap *= 2;
+    }
+    ssize_t got = read(fd, buf + len, cap - len);
+    if (got < 0) {
+      free(buf);
+      return 1;
+    } else if (got == 0) {
+      break;
+    }
+    len += (size_t)got;
+  }
+
+  // we own the buffer so the sentinel can be written in place
+  if (len && buf[len - 1] != '\n') {
+    buf[len++] = '\n';
+  }
+  in->_owned = buf;
+  in->data = slice(buf, buf + len);
+  return 0;
+}
+
+// non-zero if the file could not be mapped, caller falls back to reading
+static int _input_map(int fd, size_t len, input *in, bool prefetch) {
+  void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return 1;
+  }
+  // hints only, failure is harmless
+  madvise(map, len, MADV_SEQUENTIAL);
+  huge_advise(map, len);
+  if (prefetch) {
+    madvise(map, len, MADV_WILLNEED);
+  }
+
+  unsigned char *p = map;
+  ptrdiff_t body = _input_last_line_end(p, (ptrdiff_t)len);
+  ptrdiff_t rest = (ptrdiff_t)len - body;
+  if (rest) {
+    // the mapping is read only, copy the unterminated last line out
+    unsigned char *t = malloc(rest + 1);
+    if (t == NULL) {
+      munmap(map, len);
+      return 1;
+    }
+    memcpy(t, p + body, rest);
+    t[rest] = '\n';
+    in->_owned = t;
+    in->tail = slice(t, t + rest + 1);
+  }
+
+  in->_map = map;
+  in->_map_len = len;
+  in->data = slice(p, p + body);
+  return 0;
+}
+
+int input_open(const char *path, input *in) {
+  return input_open_with(path, in, true);
+}
+
+int input_open_with(const char *path, input *in, bool prefetch) {
+  if (path == NULL || in == NULL) {
+    return 1;
+  }
+  *in = (input){0};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return 1;
+  }
+
+  int err = 0;
+  if (S_ISREG(st.st_mode) && st.st_size == 0) {
+    // empty file, nothing to map
+  } else if (!S_ISREG(st.st_mode) ||
+             _input_map(fd, (size_t)st.st_size, in, prefetch) != 0) {
+    err = _input_read(fd, in);
+  }
+
+  // the mapping stays valid after the fd is closed
+  close(fd);
+  if (err) {
+    *in = (input){0};
+  }
+  return err;
+}
+
+void input_close(input *in) {
+  if (in == NULL) {
+    return;
+  }
+  if (in->_map) {
+    munmap(in->_map, in->_map_len);
+  }
+  free(in->_owned);
+  *in = (input){0};
+}
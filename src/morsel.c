@@ -0,0 +1,37 @@
+#include "morsel.h"
+
+void morsel_init(morsel_queue *q, str input, ptrdiff_t size) {
+  q->input = input;
+  q->size = size > 0 ? size : 1;
+  atomic_init(&q->_cursor, 0);
+}
+
+// the first line start at or after at
+static ptrdiff_t _morsel_line_start(str input, ptrdiff_t at) {
+  if (at <= 0) {
+    return 0;
+  } else if (at >= input.len) {
+    return input.len;
+  }
+  // a line starts at at if the byte before it ends a line
+  ptrdiff_t from = at - 1;
+  ptrdiff_t nl = from + find_byte(input.data + from, input.len - from, '\n');
+  return nl < input.len ? nl + 1 : input.len;
+}
+
+bool morsel_next(morsel_queue *q, str *out) {
+  ptrdiff_t start = atomic_fetch_add_explicit(&q->_cursor, q->size,
+                                              memory_order_relaxed);
+  if (start >= q->input.len) {
+    return false;
+  }
+  ptrdiff_t end = q->input.len - start > q->size ? start + q->size : q->input.len;
+
+  ptrdiff_t head = _morsel_line_start(q->input, start);
+  ptrdiff_t tail = _morsel_line_start(q->input, end);
+  if (head > tail) {
+    head = tail;
+  }
+  *out = slice(q->input.data + head, q->input.data + tail);
+  return true;
+}
@@ -1,14 +1,30 @@
+#define _GNU_SOURCE // clock_gettime on glibc
+
 #include "q_strings.h"
-#include "hash_table.h"
-// #include <cstdlib>
+#include "checkpoint.h"
+#include "chunk_reader.h"
+#include "gz_input.h"
+#include "huge.h"
+#include "input.h"
+#include "morsel.h"
+#include "output.h"
+#include "packed.h"
+#include "path_list.h"
+#include "prof.h"
+#include "schema.h"
+#include "stats_table.h"
+#include "topology.h"
 #include <assert.h>
-// #include <cstdlib.h>
-// #include <cstdlib>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 /*
@@ -33,6 +49,19 @@
 
 */
 
+// streaming mode reads through a ring of buffers, a row must fit in one
+#define STREAM_BUFF_SIZE (16 * 1024 * 1024)
+#define STREAM_BUFFS 3
+
+// mapped input is handed out in morsels of this many bytes by default
+#define MORSEL_SIZE (4 * 1024 * 1024)
+
+// sized for the 10k station variant so tables never grow mid run
+#define STATIONS_HINT 10000
+
+// --shared sizes its fixed table for this many stations unless told otherwise
+#define SHARED_KEYS 65536
+
 // distribute return struct
 typedef struct {
     bool ok;
@@ -46,13 +75,6 @@ dist_res build_result(bool ok, str *r, size_t e) {
   };    
 }  
 
-// placeholder function for threads to call
-void *thread_function(void *arg) {
-    ptrdiff_t name = *(ptrdiff_t *)arg;
-    fprintf(stdout, "My name is %td\n", name);
-    return arg;
-}
-
 /*
 
   will return an array of str that point into input
@@ -120,10 +142,10 @@ dist_res distribute(ptrdiff_t x, str input, str *out_slices, ptrdiff_t out_cap)
             tail = target;
         }
 
-        // check for end        
+        // check for end, the last slice runs to the final \n
         if (tail == input.data + input.len) {
-            out_slices[i] = slice(head, tail + 1);
-            return build_result(true, out_slices, i);
+            out_slices[i] = slice(head, tail);
+            return build_result(true, out_slices, i + 1);
         } else if (*(tail - 1) != '\n') {
           s.tail = (str){.data = tail, .len = input.len - (tail - input.data)};
           s = cut(s.tail, '\n');
@@ -133,80 +155,1095 @@ dist_res distribute(ptrdiff_t x, str input, str *out_slices, ptrdiff_t out_cap)
           tail = s.head.data + s.head.len + 1;          
         }
 
-        // otherwise update the slice and reset head for next jump        
+        // otherwise update the slice and reset head for next jump
         out_slices[i] = slice(head, tail);
         head = tail;
+
+        // newline alignment can swallow the rest of the input early
+        if (head == input.data + input.len) {
+            return build_result(true, out_slices, i + 1);
+        }
     }
 
     return build_result(true, out_slices, x);    
     
 }
 
-long get_file_length(FILE *f) {
-    if (fseek(f, 0L, SEEK_END) != 0) {
-        return -1;
+// --packed workers claim whole blocks from one cursor
+typedef struct {
+    const pack_file *file;
+    _Atomic size_t next;
+} pack_job;
+
+// a gzip worker's share of the compressed bytes and what it leaves over
+typedef struct {
+    const gz_file *file;
+    size_t from;
+    size_t to;
+    gz_part *edges;
+} gz_job;
+
+// one of several inputs, see run_files
+typedef struct {
+    const char *path;
+    input in;
+    morsel_queue queue;
+    atomic_bool tail_taken;
+    _Atomic int64_t rows;
+    _Atomic uint64_t first_ns; // when its first morsel started, 0 before
+    _Atomic uint64_t last_ns;  // when its last one was parsed
+} file_task;
+
+typedef struct {
+    file_task *files;
+    size_t count;
+} file_set;
+
+// everything a worker needs, the main thread reads the results after join
+// a worker parses its own chunk first, if any, then pulls morsels from the
+// queue or chunks from the reader until they run dry, then the morsels
+// of every file in files. with --shared all workers add into one shared
+// table instead of a private one. packed workers only use packed and
+// dense, gzip workers inflate their gz part
+typedef struct {
+    str chunk;
+    morsel_queue *queue;
+    chunk_reader *reader;
+    file_set *files;
+    size_t table_hint;
+    stats_table *table; // created by the worker so its node owns the pages
+    shared_stats *shared;
+    pack_job *packed;
+    pack_stat *dense; // one per station id
+    gz_job *gz;
+    int err;
+
+    // balance report and --stats
+    bool count; // open hardware counters for this thread
+    prof_counters counters;
+    int64_t rows;
+    prof_span parse;
+    double finished;
+} worker;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the same clock in whole nanoseconds, for atomics
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// parses name;temp\n rows into the worker's table, non-zero on error
+static int worker_parse(worker *w, str rest) {
+    prof_sample start = prof_now(&w->counters);
+    int64_t rows = 0;
+    while (rest.len) {
+        row r;
+        ptrdiff_t len = parse_row(rest, &r);
+        if (len == 0) {
+            return 1;
+        }
+        int err = w->shared
+                      ? sst_add_hashed(w->shared, r.name, r.hash, r.temp)
+                      : st_add_hashed(w->table, r.name, r.hash, r.temp);
+        if (err != 0) {
+            return 1;
+        }
+        rest = slice(rest.data + len, rest.data + rest.len);
+        rows++;
     }
+    w->rows += rows;
+    prof_add(&w->parse, &w->counters, start, prof_now(&w->counters));
+    return 0;
+}
 
-    long res = ftell(f);
-    if (res == -1) {
-        return -1;
+// worker_parse, counting the rows and time against the file they are from
+static int file_parse(worker *w, file_task *f, str lines) {
+    uint64_t start = now_ns();
+    uint64_t first = 0;
+    while ((first == 0 || start < first) &&
+           !atomic_compare_exchange_weak(&f->first_ns, &first, start)) {
+    }
+    int64_t before = w->rows;
+    if (worker_parse(w, lines) != 0) {
+        return 1;
+    }
+    atomic_fetch_add_explicit(&f->rows, w->rows - before, memory_order_relaxed);
+    uint64_t end = now_ns();
+    uint64_t last = atomic_load_explicit(&f->last_ns, memory_order_relaxed);
+    while (last < end &&
+           !atomic_compare_exchange_weak(&f->last_ns, &last, end)) {
+    }
+    return 0;
+}
+
+// drains the files one after another, a worker only moves on once the
+// file it is in has no morsels left, whoever gets there first takes the
+// file's unterminated last line
+static int worker_files(worker *w) {
+    for (size_t i = 0; i < w->files->count; ++i) {
+        file_task *f = &w->files->files[i];
+        str morsel;
+        while (morsel_next(&f->queue, &morsel)) {
+            if (file_parse(w, f, morsel) != 0) {
+                return 1;
+            }
+        }
+        if (is_valid_str(f->in.tail) &&
+            !atomic_exchange(&f->tail_taken, true) &&
+            file_parse(w, f, f->in.tail) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// thread function
+void *worker_run(void *arg) {
+    worker *w = arg;
+    w->table = st_create(w->table_hint);
+    if (w->table == NULL) {
+        w->err = 1;
+        return w;
+    }
+    prof_open(&w->counters, w->count);
+    w->err = worker_parse(w, w->chunk);
+
+    str morsel;
+    while (!w->err && w->queue && morsel_next(w->queue, &morsel)) {
+        w->err = worker_parse(w, morsel);
+    }
+
+    chunk c;
+    while (!w->err && w->reader && reader_next(w->reader, &c)) {
+        w->err = worker_parse(w, c.data);
+        reader_release(w->reader, c);
+    }
+
+    if (!w->err && w->files) {
+        w->err = worker_files(w);
+    }
+    w->finished = now();
+    prof_close(&w->counters);
+    return w;
+}
+
+static int parse_lines(void *ctx, str lines) {
+    return worker_parse(ctx, lines);
+}
+
+// thread function for gzip input, inflates and parses the worker's part
+// its parse span covers both
+void *gzip_run(void *arg) {
+    worker *w = arg;
+    w->table = st_create(w->table_hint);
+    if (w->table == NULL) {
+        w->err = 1;
+        return w;
+    }
+    prof_open(&w->counters, w->count);
+    prof_sample start = prof_now(&w->counters);
+    w->err = gz_inflate_part(w->gz->file, w->gz->from, w->gz->to, parse_lines,
+                             w, w->gz->edges);
+    w->parse = (prof_span){0};
+    prof_add(&w->parse, &w->counters, start, prof_now(&w->counters));
+    w->finished = now();
+    prof_close(&w->counters);
+    return w;
+}
+
+// thread function for --packed, sums blocks into the worker's dense array
+void *packed_run(void *arg) {
+    worker *w = arg;
+    const pack_file *f = w->packed->file;
+    w->dense = pack_stats_create(f->stations);
+    if (w->dense == NULL) {
+        w->err = 1;
+        return w;
+    }
+    prof_open(&w->counters, w->count);
+    prof_sample start = prof_now(&w->counters);
+    size_t b;
+    while (!w->err && (b = atomic_fetch_add_explicit(
+                           &w->packed->next, 1, memory_order_relaxed)) <
+                          f->blocks) {
+        int64_t rows = pack_aggregate(f, b, w->dense);
+        w->err = rows < 0;
+        w->rows += rows > 0 ? rows : 0;
+    }
+    prof_add(&w->parse, &w->counters, start, prof_now(&w->counters));
+    w->finished = now();
+    prof_close(&w->counters);
+    return w;
+}
+
+/*
+
+  per thread rows and idle time on stderr. idle is everything between
+  the workers starting and the last one finishing that a thread did not
+  spend parsing: waiting on the reader, scheduling, and sitting done
+  while slower threads catch up
+
+*/
+static void report_balance(worker *workers, size_t n, double start) {
+    double end = start;
+    for (size_t i = 0; i < n; ++i) {
+        end = workers[i].finished > end ? workers[i].finished : end;
+    }
+    double wall = end - start;
+    fprintf(stderr, "thread        rows   busy s   idle s  idle %%\n");
+    for (size_t i = 0; i < n; ++i) {
+        double idle = wall - workers[i].parse.wall;
+        fprintf(stderr, "%6zu %11lld %8.3f %8.3f %6.1f\n", i,
+                (long long)workers[i].rows, workers[i].parse.wall, idle,
+                wall > 0 ? 100 * idle / wall : 0.0);
+    }
+}
+
+typedef struct {
+    stats_table *dst;
+    stats_table *src;
+    int err;
+} merge_job;
+
+static void *merge_pair(void *arg) {
+    merge_job *j = arg;
+    j->err = st_merge(j->dst, j->src);
+    return j;
+}
+
+/*
+
+  folds every worker's table into the first worker's as a tree, round r
+  merges table i + 2^r into table i for every i that is a multiple of
+  2^(r + 1). the pairs of a round touch disjoint tables so they run in
+  parallel, log2(n) rounds instead of n - 1 merges on one core. the main
+  thread takes the first pair of each round itself
+
+*/
+static int merge(worker *workers, size_t n) {
+    size_t pairs = n / 2;
+    merge_job *jobs = calloc(pairs ? pairs : 1, sizeof(merge_job));
+    pthread_t *threads = calloc(pairs ? pairs : 1, sizeof(pthread_t));
+    bool *spawned = calloc(pairs ? pairs : 1, sizeof(bool));
+    int err = jobs == NULL || threads == NULL || spawned == NULL;
+
+    for (size_t stride = 1; !err && stride < n; stride *= 2) {
+        size_t k = 0;
+        for (size_t i = 0; i + stride < n; i += 2 * stride, ++k) {
+            jobs[k] = (merge_job){.dst = workers[i].table,
+                                 .src = workers[i + stride].table};
+            spawned[k] = k > 0 && pthread_create(&threads[k], NULL, merge_pair,
+                                                 &jobs[k]) == 0;
+        }
+        // the first pair, and any that could not get a thread, run here
+        for (size_t j = 0; j < k; ++j) {
+            if (!spawned[j]) {
+                merge_pair(&jobs[j]);
+            }
+        }
+        for (size_t j = 0; j < k; ++j) {
+            if (spawned[j]) {
+                pthread_join(threads[j], NULL);
+            }
+            err |= jobs[j].err;
+        }
+    }
+
+    free(spawned);
+    free(threads);
+    free(jobs);
+    return err;
+}
+
+typedef struct {
+    char **args;       // the positional arguments, see path_list_expand
+    size_t n_args;
+    path_list inputs;  // what they expand to
+    const char *path;  // the first input
+    bool stream;
+    bool static_split;
+    bool report;
+    ptrdiff_t morsel;
+    size_t shared_keys; // zero for private tables
+    bool pin;
+    prof_config stats;  // format is PROF_OFF unless asked for
+    const char *checkpoint; // null unless --checkpoint
+    bool packed;
+} options;
+
+/*
+
+  --stats, or MT_STATS in the environment, times every phase on the main
+  thread and the parse on every worker. parsing and the table updates
+  are one fused loop per row, timing them apart would cost more than
+  either, so they are reported together. reading is what happens before
+  the workers start: mapping the file, or with --stream starting the io
+  thread whose reads then overlap the parse. the parse phase is wall time
+  from the first worker starting to the last one joining, its counters
+  are the workers' summed
+
+*/
+enum { PHASE_READ, PHASE_SPLIT, PHASE_PARSE, PHASE_MERGE, PHASE_OUTPUT, PHASES };
+
+typedef struct {
+    prof_counters counters; // the main thread's
+    prof_phase phases[PHASES];
+} profile;
+
+static void profile_init(profile *p, const options *o) {
+    *p = (profile){.phases = {
+                       [PHASE_READ] = {.name = "read"},
+                       [PHASE_SPLIT] = {.name = "split"},
+                       [PHASE_PARSE] = {.name = "parse"},
+                       [PHASE_MERGE] = {.name = "merge"},
+                       [PHASE_OUTPUT] = {.name = "output"},
+                   }};
+    prof_open(&p->counters, o->stats.format != PROF_OFF && o->stats.counters);
+}
+
+// closes the main thread's phase that started at from
+static void phase_end(profile *p, int phase, prof_sample from) {
+    prof_add(&p->phases[phase].span, &p->counters, from,
+             prof_now(&p->counters));
+}
+
+// prints the phases and the workers' parse spans on stderr
+static int profile_report(profile *p, const options *o, worker *workers,
+                          size_t n, double start, double joined) {
+    if (o->stats.format == PROF_OFF) {
+        return 0;
+    }
+    prof_span *spans = calloc(n ? n : 1, sizeof(prof_span));
+    int64_t *rows = calloc(n ? n : 1, sizeof(int64_t));
+    if (spans == NULL || rows == NULL) {
+        free(spans);
+        free(rows);
+        return 1;
+    }
+
+    prof_span parse = {0};
+    for (size_t i = 0; i < n; ++i) {
+        spans[i] = workers[i].parse;
+        rows[i] = workers[i].rows;
+        prof_sum(&parse, &spans[i]);
+    }
+    parse.wall = joined - start;
+    p->phases[PHASE_PARSE].span = parse;
+    prof_report(stderr, o->stats, p->phases, PHASES, spans, rows, n);
+
+    free(spans);
+    free(rows);
+    return 0;
+}
+
+// non-zero on bad arguments
+static int parse_options(int argc, char **argv, options *o) {
+    *o = (options){.morsel = MORSEL_SIZE, .args = calloc(argc, sizeof(char *))};
+    if (o->args == NULL) {
+        return 1;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stream") == 0) {
+            o->stream = true;
+        } else if (strcmp(argv[i], "--static") == 0) {
+            o->static_split = true;
+        } else if (strcmp(argv[i], "--report") == 0) {
+            o->report = true;
+        } else if (strcmp(argv[i], "--shared") == 0) {
+            o->shared_keys = SHARED_KEYS;
+        } else if (strncmp(argv[i], "--shared=", 9) == 0) {
+            long keys = atol(argv[i] + 9);
+            if (keys <= 0) {
+                return 1;
+            }
+            o->shared_keys = keys;
+        } else if (strcmp(argv[i], "--no-huge") == 0) {
+            huge_disable();
+        } else if (strcmp(argv[i], "--packed") == 0) {
+            o->packed = true;
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            o->pin = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            o->stats = (prof_config){.format = PROF_TEXT};
+        } else if (strncmp(argv[i], "--stats=", 8) == 0) {
+            if (prof_parse(argv[i] + 8, &o->stats) != 0) {
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--checkpoint=", 13) == 0) {
+            o->checkpoint = argv[i] + 13;
+            if (*o->checkpoint == '\0') {
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--morsel-kb=", 12) == 0) {
+            o->morsel = atol(argv[i] + 12) * 1024;
+            if (o->morsel <= 0) {
+                return 1;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            return 1;
+        } else {
+            o->args[o->n_args++] = argv[i];
+        }
     }
+    return o->n_args == 0;
+}
+
+// regular files are mapped, everything else has to be streamed
+static bool must_stream(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && !S_ISREG(st.st_mode);
+}
 
-    if (fseek(f, 0L, SEEK_SET) != 0) {
+// one worker per online cpu
+static ptrdiff_t worker_count(void) {
+    ptrdiff_t n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+// starts fn on each of n workers, pinned with --pin, returns how many
+// threads could be started
+static size_t start_workers(pthread_t *threads, worker *workers, size_t n,
+                            const options *o, void *(*fn)(void *)) {
+    topology topo = {0};
+    if (o->pin && topology_load(&topo) != 0) {
+        fputs("Failed to read the cpu topology, running unpinned.\n", stderr);
+    }
+
+    size_t started = 0;
+    for (size_t i = 0; i < n; ++i) {
+        workers[i].count = o->stats.format != PROF_OFF && o->stats.counters;
+        pthread_attr_t attr;
+        if (pthread_attr_init(&attr) != 0) {
+            break;
+        }
+        if (topo.count) {
+            topology_pin(&attr, topo.cpus[i % topo.count]);
+        }
+        int created = pthread_create(&threads[i], &attr, fn, &workers[i]) == 0;
+        pthread_attr_destroy(&attr);
+        if (!created) {
+            break;
+        }
+        started++;
+    }
+    topology_free(&topo);
+    return started;
+}
+
+// joins the started workers, non-zero if any of them failed
+static int join_workers(pthread_t *threads, worker *workers, size_t started,
+                        const options *o, double start) {
+    int err = 0;
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        err |= workers[i].err;
+    }
+    if (o->report) {
+        report_balance(workers, started, start);
+    }
+    return err;
+}
+
+/*
+
+  --checkpoint=PATH keeps the aggregates of an append only file between
+  runs. the checkpoint covers the file up to its last \n at the time, if
+  the file still starts with exactly those bytes only what came after is
+  handed to the workers and the saved stations are folded into their
+  merged table. a new checkpoint is then saved for everything up to the
+  current last \n, before an unterminated last line is added, that line
+  may still be half written and is parsed again next time
+
+*/
+typedef struct {
+    stats_table *base; // the checkpoint's stations, empty after a full scan
+    ckpt_ident id;     // the input as it is now, saved after the merge
+    str tail;          // a last line without \n, parsed after saving
+} resume;
+
+// loads the checkpoint, returns the offset the workers start at or -1
+static ptrdiff_t resume_open(const options *o, const input *in, resume *r) {
+    *r = (resume){.tail = in->tail};
+    if (ckpt_identify(o->path, in->data, &r->id) != 0 ||
+        (r->base = st_create(STATIONS_HINT)) == NULL) {
+        return -1;
+    }
+    ckpt_ident saved;
+    if (ckpt_load(o->checkpoint, &saved, r->base) == 0 &&
+        ckpt_matches(&saved, o->path, in->data)) {
+        if (o->report) {
+            fprintf(stderr, "checkpoint resumed at %llu bytes\n",
+                    (unsigned long long)saved.offset);
+        }
+        return (ptrdiff_t)saved.offset;
+    }
+    // missing, damaged or for other contents, a failed load may have
+    // left some stations behind
+    st_destroy(&r->base);
+    if ((r->base = st_create(STATIONS_HINT)) == NULL) {
         return -1;
     }
+    if (o->report) {
+        fputs("checkpoint not usable, full scan\n", stderr);
+    }
+    return 0;
+}
 
-    return res;    
-}  
+// folds the checkpoint into table, saves the new one, then adds the tail
+static int resume_finish(const options *o, resume *r, stats_table *table) {
+    if (st_merge(table, r->base) != 0) {
+        return 1;
+    }
+    if (ckpt_save(o->checkpoint, &r->id, table) != 0) {
+        perror("Failed to save checkpoint.");
+        return 1;
+    }
+    if (!is_valid_str(r->tail)) {
+        return 0;
+    }
+    worker w = {.table = table};
+    prof_open(&w.counters, false);
+    return worker_parse(&w, r->tail);
+}
 
-int main() {
-//    FILE *f = fopen("/Users/tariqs/Documents/projects/code/one_billion_lines/data/measurements.txt",
-//                    "r");
-    FILE *f = fopen("/Users/tariqs/Documents/projects/code/one_billion_lines/data/"
-                    "1000_lines.txt",
-                    "r");
-    if (!f) {
-        return EXIT_FAILURE;
+/*
+
+  runs n prepared workers to completion, merges their tables and prints
+  the result. frees the workers' tables either way, non-zero on error.
+  with a shared table there is nothing to merge, it is exported into the
+  first worker's table once everyone has joined. r is null unless
+  --checkpoint, see resume.
+
+  with --pin worker i starts on the i-th cpu of the topology, which lists
+  cpus node by node. the workers of a node are consecutive, and so are
+  the distribute() slices they are handed, every node gets one contiguous
+  region of the input. each worker allocates its own table after it is
+  pinned so the table's pages are first touched on its node
+
+*/
+static int run_workers(worker *workers, size_t n, const options *o,
+                       profile *p, resume *r) {
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    if (threads == NULL) {
+        return 1;
+    }
+    shared_stats *shared = NULL;
+    if (o->shared_keys && (shared = sst_create(o->shared_keys)) == NULL) {
+        free(threads);
+        return 1;
     }
 
-    // generate threads
-    //    const ptrdiff_t n_processors = sysconf(_SC_NPROCESSORS_ONLN);
-    //    fprintf(stdout, "Making %td threads.\n\n", n_processors);
-    //    pthread_t threads[n_processors];
-    //    for (ptrdiff_t i = 0; i < n_processors; ++i) {
-    //        pthread_create(&threads[i], NULL, thread_function, &i);
-    //    }
+    for (size_t i = 0; i < n; ++i) {
+        workers[i].shared = shared;
+        // only the first table is used with a shared one, for the export
+        workers[i].table_hint = shared && i ? 0 : STATIONS_HINT;
+    }
+    double start = now();
+    size_t started = start_workers(threads, workers, n, o, worker_run);
+    int err = join_workers(threads, workers, started, o, start) || started != n;
+    double joined = now();
 
-    uint64_t file_len = get_file_length(f);
-    
-    str input = {0};
-    input.data = calloc(file_len + 1, sizeof(char));    
-    if (input.data == NULL) {
-        return EXIT_FAILURE;
+    prof_sample from = prof_now(&p->counters);
+    if (err || started == 0) {
+        err = 1;
+    } else if (shared ? sst_export(shared, workers[0].table) != 0
+                      : merge(workers, started) != 0) {
+        err = 1;
+    } else if (r && resume_finish(o, r, workers[0].table) != 0) {
+        err = 1;
+    }
+    phase_end(p, PHASE_MERGE, from);
+    if (o->report) {
+        fprintf(stderr, "merge %.3f s\n", p->phases[PHASE_MERGE].span.wall);
+    }
+
+    from = prof_now(&p->counters);
+    if (!err && write_results(STDOUT_FILENO, workers[0].table) != 0) {
+        err = 1;
+    }
+    phase_end(p, PHASE_OUTPUT, from);
+    err |= profile_report(p, o, workers, started, start, joined);
+
+    for (size_t i = 0; i < started; ++i) {
+        st_destroy(&workers[i].table);
+    }
+    if (shared) {
+        sst_destroy(&shared);
+    }
+    free(threads);
+    return err;
+}
+
+// every worker pulls chunks from one reader fed by its io thread
+static int run_streamed(const options *o, profile *p) {
+    prof_sample from = prof_now(&p->counters);
+    int fd = open(o->path, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file.");
+        return 1;
+    }
+    chunk_reader *r = reader_create(fd, STREAM_BUFF_SIZE, STREAM_BUFFS);
+    if (r == NULL) {
+        close(fd);
+        return 1;
+    }
+    phase_end(p, PHASE_READ, from);
+
+    ptrdiff_t x = worker_count();
+    worker *workers = calloc(x, sizeof(worker));
+    int err = workers == NULL;
+    if (!err) {
+        for (ptrdiff_t i = 0; i < x; ++i) {
+            workers[i].reader = r;
+        }
+        err = run_workers(workers, x, o, p, NULL);
+    }
+
+    err |= reader_destroy(&r);
+    close(fd);
+    free(workers);
+    return err;
+}
+
+/*
+
+  --packed reads a file written by pack_measurements. workers claim whole
+  blocks and sum them into a dense array indexed by station id, the
+  arrays are added up and only then turned into a table by name
+
+*/
+static int run_packed(const options *o, profile *p) {
+    prof_sample from = prof_now(&p->counters);
+    pack_file f;
+    if (pack_open(o->path, &f) != 0) {
+        fputs("Failed to open packed file.\n", stderr);
+        return 1;
+    }
+    phase_end(p, PHASE_READ, from);
+
+    ptrdiff_t x = worker_count();
+    pack_job job = {.file = &f};
+    atomic_init(&job.next, 0);
+    worker *workers = calloc(x, sizeof(worker));
+    pthread_t *threads = calloc(x, sizeof(pthread_t));
+    stats_table *table = st_create(f.stations);
+    int err = workers == NULL || threads == NULL || table == NULL;
+    size_t started = 0;
+    double start = now();
+    double joined = start;
+    if (!err) {
+        for (ptrdiff_t i = 0; i < x; ++i) {
+            workers[i].packed = &job;
+        }
+        start = now();
+        started = start_workers(threads, workers, x, o, packed_run);
+        err = join_workers(threads, workers, started, o, start) ||
+              started == 0;
+        joined = now();
+    }
+
+    from = prof_now(&p->counters);
+    if (!err) {
+        for (size_t i = 1; i < started; ++i) {
+            pack_stats_merge(workers[0].dense, workers[i].dense, f.stations);
+        }
+        err = pack_export(&f, workers[0].dense, table) != 0;
+    }
+    phase_end(p, PHASE_MERGE, from);
+    if (o->report) {
+        fprintf(stderr, "merge %.3f s\n", p->phases[PHASE_MERGE].span.wall);
+    }
+
+    from = prof_now(&p->counters);
+    if (!err && write_results(STDOUT_FILENO, table) != 0) {
+        err = 1;
+    }
+    phase_end(p, PHASE_OUTPUT, from);
+    err |= profile_report(p, o, workers, started, start, joined);
+
+    for (size_t i = 0; i < started; ++i) {
+        free(workers[i].dense);
+    }
+    st_destroy(&table);
+    free(threads);
+    free(workers);
+    pack_close(&f);
+    return err;
+}
+
+/*
+
+  a gzip file is cut into one part of compressed bytes per worker, see
+  gz_input.h. every worker inflates the members that start in its part
+  and parses the whole lines as they come out into its own table. after
+  the merge the lines that straddle two parts are stitched together and
+  added on the main thread
+
+*/
+static int run_gzip(const options *o, profile *p) {
+    prof_sample from = prof_now(&p->counters);
+    gz_file f;
+    if (gz_open(o->path, &f) != 0) {
+        fputs("Failed to open gzip file.\n", stderr);
+        return 1;
+    }
+    phase_end(p, PHASE_READ, from);
+
+    from = prof_now(&p->counters);
+    ptrdiff_t x = worker_count();
+    worker *workers = calloc(x, sizeof(worker));
+    gz_job *jobs = calloc(x, sizeof(gz_job));
+    gz_part *edges = calloc(x, sizeof(gz_part));
+    pthread_t *threads = calloc(x, sizeof(pthread_t));
+    int err = workers == NULL || jobs == NULL || edges == NULL ||
+              threads == NULL;
+    for (ptrdiff_t i = 0; !err && i < x; ++i) {
+        jobs[i] = (gz_job){.file = &f,
+                           .from = f.len * i / x,
+                           .to = f.len * (i + 1) / x,
+                           .edges = &edges[i]};
+        workers[i].gz = &jobs[i];
+        workers[i].table_hint = STATIONS_HINT;
+    }
+    phase_end(p, PHASE_SPLIT, from);
+
+    size_t started = 0;
+    double start = now();
+    double joined = start;
+    if (!err) {
+        started = start_workers(threads, workers, x, o, gzip_run);
+        err = join_workers(threads, workers, started, o, start) ||
+              started != (size_t)x;
+        joined = now();
+    }
+
+    from = prof_now(&p->counters);
+    if (!err && merge(workers, started) != 0) {
+        err = 1;
+    }
+    if (!err) {
+        worker w = {.table = workers[0].table};
+        prof_open(&w.counters, false);
+        err = gz_stitch(edges, x, parse_lines, &w);
+    }
+    phase_end(p, PHASE_MERGE, from);
+    if (o->report && !err) {
+        uint64_t members = 0;
+        uint64_t bytes = 0;
+        for (ptrdiff_t i = 0; i < x; ++i) {
+            members += edges[i].members;
+            bytes += edges[i].bytes;
+        }
+        fprintf(stderr, "merge %.3f s\n", p->phases[PHASE_MERGE].span.wall);
+        fprintf(stderr, "gzip %llu members, %.1f MB to %.1f MB\n",
+                (unsigned long long)members, f.len / 1e6, bytes / 1e6);
+    }
+
+    from = prof_now(&p->counters);
+    if (!err && write_results(STDOUT_FILENO, workers[0].table) != 0) {
+        err = 1;
     }
+    phase_end(p, PHASE_OUTPUT, from);
+    err |= profile_report(p, o, workers, started, start, joined);
 
-    input.len = (ptrdiff_t)fread(input.data, sizeof(char), file_len, f);
-    if (input.len <= 0) {
+    for (size_t i = 0; i < started; ++i) {
+        st_destroy(&workers[i].table);
+    }
+    for (ptrdiff_t i = 0; edges && i < x; ++i) {
+        gz_part_free(&edges[i]);
+    }
+    free(threads);
+    free(edges);
+    free(jobs);
+    free(workers);
+    gz_close(&f);
+    return err;
+}
+
+/*
+
+  --report with several inputs, rows and throughput per file on stderr.
+  a file's time runs from its first morsel starting to its last one being
+  parsed. files are worked on side by side, so their times overlap and
+  add up to more than the total, which spans all of them
+
+*/
+static void report_files(const file_set *s) {
+    uint64_t first = UINT64_MAX;
+    uint64_t last = 0;
+    int64_t rows = 0;
+    double bytes = 0;
+    fprintf(stderr, "       rows       MB       ms     MB/s  file\n");
+    for (size_t i = 0; i < s->count; ++i) {
+        const file_task *f = &s->files[i];
+        uint64_t from = atomic_load(&f->first_ns);
+        uint64_t to = atomic_load(&f->last_ns);
+        double ms = to > from ? (to - from) * 1e-6 : 0.0;
+        double mb = (f->in.data.len + f->in.tail.len) / 1e6;
+        int64_t n = atomic_load(&f->rows);
+        fprintf(stderr, "%11lld %8.1f %8.1f %8.1f  %s\n", (long long)n, mb, ms,
+                ms > 0 ? mb / ms * 1e3 : 0.0, f->path);
+        if (from) {
+            first = from < first ? from : first;
+            last = to > last ? to : last;
+        }
+        rows += n;
+        bytes += mb;
+    }
+    double ms = last > first ? (last - first) * 1e-6 : 0.0;
+    fprintf(stderr, "%11lld %8.1f %8.1f %8.1f  total, %zu files\n",
+            (long long)rows, bytes, ms, ms > 0 ? bytes / ms * 1e3 : 0.0,
+            s->count);
+}
+
+/*
+
+  several inputs share one pool of workers. every file is mapped up front
+  with its own morsel queue and the workers drain the queues in order,
+  each into its one table for all of them. a small file costs a morsel or
+  two instead of its own round of threads, splitting and merging, and the
+  workers spill over into the next file while the last morsels of one are
+  still being parsed
+
+*/
+static int run_files(const options *o, profile *p) {
+    prof_sample from = prof_now(&p->counters);
+    file_set set = {.files = calloc(o->inputs.count, sizeof(file_task))};
+    if (set.files == NULL) {
+        return 1;
+    }
+    int err = 0;
+    for (; set.count < o->inputs.count; ++set.count) {
+        file_task *f = &set.files[set.count];
+        f->path = o->inputs.paths[set.count];
+        // pinned workers fault in their own morsels, see run_workers
+        if (input_open_with(f->path, &f->in, !o->pin) != 0) {
+            fprintf(stderr, "Failed to open %s.\n", f->path);
+            err = 1;
+            break;
+        }
+        morsel_init(&f->queue, f->in.data, o->morsel);
+        atomic_init(&f->tail_taken, false);
+        atomic_init(&f->rows, 0);
+        atomic_init(&f->first_ns, 0);
+        atomic_init(&f->last_ns, 0);
+    }
+    phase_end(p, PHASE_READ, from);
+
+    ptrdiff_t x = worker_count();
+    worker *workers = err ? NULL : calloc(x, sizeof(worker));
+    if (workers) {
+        for (ptrdiff_t i = 0; i < x; ++i) {
+            workers[i].files = &set;
+        }
+        err = run_workers(workers, x, o, p, NULL);
+        if (!err && o->report) {
+            report_files(&set);
+        }
+    } else {
+        err = 1;
+    }
+
+    for (size_t i = 0; i < set.count; ++i) {
+        input_close(&set.files[i].in);
+    }
+    free(workers);
+    free(set.files);
+    return err;
+}
+
+// the whole input is mapped, workers claim morsels of it until it is
+// exhausted, or with --static take one distribute() slice each
+static int run_mapped(const options *o, profile *p) {
+    prof_sample from = prof_now(&p->counters);
+    input in;
+    // pinned workers fault in their own regions instead, see run_workers
+    if (input_open_with(o->path, &in, !o->pin) != 0) {
+        perror("Failed to open file.");
+        return 1;
+    }
+    phase_end(p, PHASE_READ, from);
+
+    // input_open guarantees every line, including a copied out tail, ends
+    // in \n, so both go to the workers as they are. with a checkpoint the
+    // workers only see the lines after it and the tail is kept for later
+    str input = in.data;
+    str tail = in.tail;
+    resume r = {0};
+    if (o->checkpoint) {
+        ptrdiff_t offset = resume_open(o, &in, &r);
+        if (offset < 0) {
+            st_destroy(&r.base);
+            input_close(&in);
+            return 1;
+        }
+        input = slice(input.data + offset, input.data + input.len);
+        tail = (str){0};
+    }
+
+    // distribute needs more bytes than slices
+    ptrdiff_t x = worker_count();
+    if (o->static_split && x >= input.len) {
+        x = input.len > 1 ? input.len - 1 : 1;
+    }
+
+    // one extra slot for the tail line
+    str *slices = calloc(x + 1, sizeof(str));
+    worker *workers = calloc(x + 1, sizeof(worker));
+    if (slices == NULL || workers == NULL) {
+        free(slices);
+        free(workers);
+        input_close(&in);
+        return 1;
+    }
+
+    if (input.len == 0 && !is_valid_str(in.tail) && !o->checkpoint) {
+        fputs("{}\n", stdout);
+        free(workers);
+        free(slices);
+        input_close(&in);
+        return 0;
+    }
+
+    int err = 0;
+    morsel_queue queue;
+    from = prof_now(&p->counters);
+    resume *rp = o->checkpoint ? &r : NULL;
+    // nothing appended since the checkpoint leaves nothing to distribute
+    if (!o->static_split || (input.len == 0 && !is_valid_str(tail))) {
+        morsel_init(&queue, input, o->morsel);
+        for (ptrdiff_t i = 0; i < x; ++i) {
+            workers[i].queue = &queue;
+        }
+        workers[0].chunk = tail;
+        phase_end(p, PHASE_SPLIT, from);
+        err = run_workers(workers, x, o, p, rp);
+    } else {
+        dist_res res = build_result(true, slices, 0);
+        if (input.len == 1) {
+            // a lone \n, nothing for distribute to split
+            slices[0] = input;
+            res = build_result(true, slices, 1);
+        } else if (input.len > 1) {
+            res = distribute(x, input, slices, x);
+        }
+        if (res.ok && is_valid_str(tail)) {
+            slices[res.elements++] = tail;
+        }
+        err = !res.ok;
+        phase_end(p, PHASE_SPLIT, from);
+        if (res.ok) {
+            for (size_t i = 0; i < res.elements; ++i) {
+                workers[i].chunk = res.result[i];
+            }
+            err = run_workers(workers, res.elements, o, p, rp);
+        }
+    }
+
+    st_destroy(&r.base);
+    free(workers);
+    free(slices);
+    input_close(&in);
+    return err;
+}
+
+typedef int (*run_fn)(const options *o, profile *p);
+
+// how the inputs are read, null after saying why if the options don't go
+// together
+static run_fn pick_run(const options *o) {
+    if (o->inputs.count > 1) {
+        if (o->stream || o->static_split || o->checkpoint || o->packed) {
+            fputs("several inputs only go with --morsel-kb, --shared, --pin, "
+                  "--report and --stats\n",
+                  stderr);
+            return NULL;
+        }
+        for (size_t i = 0; i < o->inputs.count; ++i) {
+            if (gz_sniff(o->inputs.paths[i])) {
+                fprintf(stderr, "%s is gzip, several inputs must be text\n",
+                        o->inputs.paths[i]);
+                return NULL;
+            }
+        }
+        return run_files;
+    }
+
+    bool streamed = o->stream || must_stream(o->path);
+    if (o->checkpoint && streamed) {
+        fputs("--checkpoint needs a regular file, it can't be streamed\n",
+              stderr);
+        return NULL;
+    }
+    if (o->packed && (o->stream || o->static_split || o->shared_keys ||
+                      o->checkpoint)) {
+        fputs("--packed only goes with --pin, --report and --stats\n",
+              stderr);
+        return NULL;
+    }
+    // gzip is recognised by its magic bytes, in a regular file only
+    bool gz = !o->packed && !streamed && gz_sniff(o->path);
+    if (gz && (o->static_split || o->shared_keys || o->checkpoint)) {
+        fputs("gzip input only goes with --pin, --report and --stats\n",
+              stderr);
+        return NULL;
+    }
+    return o->packed   ? run_packed
+           : gz       ? run_gzip
+           : streamed ? run_streamed
+                      : run_mapped;
+}
+
+int main(int argc, char **argv) {
+    options o;
+    if (parse_options(argc, argv, &o) != 0) {
+        fprintf(stderr,
+                "usage: %s [--stream | --static | --morsel-kb=N] "
+                "[--shared[=KEYS]] [--pin] [--no-huge] [--report] "
+                "[--checkpoint=PATH | --packed] "
+                "[--stats[=text|json][,counters]] <file | dir | glob>...\n",
+                argv[0]);
+        free(o.args);
         return EXIT_FAILURE;
     }
-    
-    // ensure \n on end of input
-    input.data[input.len] = '\n';
-    ++input.len;
-
-    ptrdiff_t x = 5;
-    str slices[x];
-    dist_res res = distribute(x, input, slices, x);
-    if (!res.ok) {
+    const char *env = getenv("MT_STATS");
+    if (o.stats.format == PROF_OFF && env && prof_parse(env, &o.stats) != 0) {
+        fputs("MT_STATS should look like text, json or json,counters\n",
+              stderr);
+        free(o.args);
         return EXIT_FAILURE;
     }
 
-    fprintf(stdout, "Result has %zu elements.\n", res.elements);
-
-    for (size_t i = 0; i < res.elements; ++i) {
-        fprintf(stdout, "%zuth string has %td elements.\n", i, res.result[i].len);
+    // a directory or a glob can stand for many files, or for just one
+    int err = path_list_expand(o.args, o.n_args, &o.inputs);
+    free(o.args);
+    o.args = NULL;
+    if (err) {
+        fputs("No input files found.\n", stderr);
+        return EXIT_FAILURE;
     }
-    fputs("\n", stdout);
-    
-    return 0;    
+    o.path = o.inputs.paths[0];
+    run_fn run = pick_run(&o);
+    if (run) {
+        profile p;
+        profile_init(&p, &o);
+        err = run(&o, &p);
+        prof_close(&p.counters);
+    }
+    path_list_free(&o.inputs);
+    if (run == NULL) {
+        return EXIT_FAILURE;
+    }
+    if (err) {
+        fputs("Failed to aggregate input.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,195 @@
+#include "output.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// worst case for one number, sign, 19 digits and the point
+#define TENTHS_MAX 21
+
+// below this a partition is finished with insertion sort
+#define SORT_CUTOFF 12
+
+ptrdiff_t format_tenths(unsigned char *out, int64_t v) {
+  unsigned char *p = out;
+  // work on the magnitude as unsigned so INT64_MIN is fine too
+  uint64_t m = (uint64_t)v;
+  if (v < 0) {
+    *p++ = '-';
+    m = -m;
+  }
+
+  // digits come out backwards, the last one is the tenth
+  unsigned char digits[TENTHS_MAX];
+  ptrdiff_t n = 0;
+  do {
+    digits[n++] = '0' + m % 10;
+    m /= 10;
+  } while (m);
+  if (n == 1) {
+    digits[n++] = '0';
+  }
+
+  while (n > 1) {
+    *p++ = digits[--n];
+  }
+  *p++ = '.';
+  *p++ = digits[0];
+  return p - out;
+}
+
+// byte d of a slot's key, -1 once past its end so shorter keys sort first
+static inline int _byte_at(st_slot *s, ptrdiff_t d) {
+  str key = st_key(s);
+  return d < key.len ? key.data[d] : -1;
+}
+
+// keys that already agree on their first d bytes
+static int _cmp_from(st_slot *a, st_slot *b, ptrdiff_t d) {
+  str x = st_key(a);
+  str y = st_key(b);
+  ptrdiff_t n = x.len < y.len ? x.len : y.len;
+  for (; d < n; ++d) {
+    if (x.data[d] != y.data[d]) {
+      return x.data[d] - y.data[d];
+    }
+  }
+  return (x.len > y.len) - (x.len < y.len);
+}
+
+static inline void _swap(st_slot **a, st_slot **b) {
+  st_slot *t = *a;
+  *a = *b;
+  *b = t;
+}
+
+/*
+
+  bentley and sedgewick's multikey quicksort. partitions on byte d into
+  less, equal and greater, only the equal part moves on to byte d + 1.
+  the largest of the three parts is looped on and the other two are
+  recursed into. they hold at most half of n each, so the recursion is
+  at most log2(n) deep whatever the keys.
+
+*/
+static void _mkqs(st_slot **s, size_t n, ptrdiff_t d) {
+  while (n > SORT_CUTOFF) {
+    _swap(&s[0], &s[n / 2]);
+    int pivot = _byte_at(s[0], d);
+
+    // [0, lt) less, [lt, i) equal, [i, gt] unseen, (gt, n) greater
+    size_t lt = 0, i = 1, gt = n - 1;
+    while (i <= gt) {
+      int c = _byte_at(s[i], d);
+      if (c < pivot) {
+        _swap(&s[lt++], &s[i++]);
+      } else if (c > pivot) {
+        _swap(&s[i], &s[gt--]);
+      } else {
+        i++;
+      }
+    }
+
+    struct {
+      st_slot **s;
+      size_t n;
+      ptrdiff_t d;
+    } part[3] = {
+        {s, lt, d},
+        // every key in the middle ended at d when pivot < 0, they are equal
+        {s + lt, pivot < 0 ? 0 : gt + 1 - lt, d + 1},
+        {s + gt + 1, n - gt - 1, d},
+    };
+    int big = 0;
+    for (int k = 1; k < 3; ++k) {
+      big = part[k].n > part[big].n ? k : big;
+    }
+    for (int k = 0; k < 3; ++k) {
+      if (k != big) {
+        _mkqs(part[k].s, part[k].n, part[k].d);
+      }
+    }
+    s = part[big].s;
+    n = part[big].n;
+    d = part[big].d;
+  }
+
+  for (size_t i = 1; i < n; ++i) {
+    for (size_t j = i; j > 0 && _cmp_from(s[j - 1], s[j], d) > 0; --j) {
+      _swap(&s[j - 1], &s[j]);
+    }
+  }
+}
+
+void sort_slots(st_slot **slots, size_t n) {
+  if (slots != NULL) {
+    _mkqs(slots, n, 0);
+  }
+}
+
+str format_results(stats_table *table) {
+  size_t n = st_count(table);
+  st_slot **sorted = malloc((n ? n : 1) * sizeof(st_slot *));
+  if (sorted == NULL) {
+    return (str){0};
+  }
+
+  // "{" and "}\n", then per key its bytes, "=//", ", " and three numbers
+  size_t size = 3;
+  size_t i = 0;
+  for (size_t j = 0; j < n; ++j) {
+    sorted[j] = st_next(table, &i);
+    size += st_key(sorted[j]).len + 5 + 3 * TENTHS_MAX;
+  }
+  sort_slots(sorted, n);
+
+  unsigned char *out = malloc(size);
+  if (out == NULL) {
+    free(sorted);
+    return (str){0};
+  }
+
+  unsigned char *p = out;
+  *p++ = '{';
+  for (size_t j = 0; j < n; ++j) {
+    st_slot *s = sorted[j];
+    str name = st_key(s);
+    if (j) {
+      *p++ = ',';
+      *p++ = ' ';
+    }
+    memcpy(p, name.data, name.len);
+    p += name.len;
+    *p++ = '=';
+    p += format_tenths(p, s->min);
+    *p++ = '/';
+    p += format_tenths(p, mean_tenths(s->sum, s->count));
+    *p++ = '/';
+    p += format_tenths(p, s->max);
+  }
+  *p++ = '}';
+  *p++ = '\n';
+
+  free(sorted);
+  return (str){.data = out, .len = p - out};
+}
+
+int write_results(int fd, stats_table *table) {
+  str out = format_results(table);
+  if (!is_valid_str(out)) {
+    return 1;
+  }
+
+  // one call unless the kernel takes less, as pipes may
+  str rest = out;
+  while (rest.len) {
+    ssize_t n = write(fd, rest.data, rest.len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      break;
+    }
+    rest = slice(rest.data + n, rest.data + rest.len);
+  }
+  free(out.data);
+  return rest.len != 0;
+}
@@ -0,0 +1,68 @@
+#include "input.h"
+#include "packed.h"
+#include "q_strings.h"
+#include "schema.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+
+  converts a text measurements file into the packed format, see packed.h.
+  every row is parsed and checked once here so repeat scans with
+  multithreaded --packed never have to.
+
+    pack_measurements <measurements.txt> <out.pack>
+
+*/
+
+// adds the rows of rest, non-zero on a malformed row or a full dictionary
+static int pack_rows(pack_writer *w, str rest, ptrdiff_t *at) {
+  while (rest.len) {
+    row r;
+    ptrdiff_t len = parse_row(rest, &r);
+    if (len == 0) {
+      fprintf(stderr, "malformed row at byte %td\n", *at);
+      return 1;
+    }
+    int err = pack_add(w, r.name, r.temp);
+    if (err == 1) {
+      fprintf(stderr, "more than %d stations\n", PACK_MAX_STATIONS);
+    }
+    if (err != 0) {
+      return 1;
+    }
+    rest = slice(rest.data + len, rest.data + rest.len);
+    *at += len;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <measurements.txt> <out.pack>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  input in;
+  if (input_open(argv[1], &in) != 0) {
+    perror("Failed to open file.");
+    return EXIT_FAILURE;
+  }
+  pack_writer *w = pack_create(argv[2]);
+  if (w == NULL) {
+    perror("Failed to create output.");
+    input_close(&in);
+    return EXIT_FAILURE;
+  }
+
+  ptrdiff_t at = 0;
+  int err = pack_rows(w, in.data, &at) || pack_rows(w, in.tail, &at);
+  if (err) {
+    pack_discard(&w);
+  } else if (pack_finish(&w) != 0) {
+    perror("Failed to write output.");
+    err = 1;
+  }
+  input_close(&in);
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
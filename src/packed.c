@@ -0,0 +1,384 @@
+#define _GNU_SOURCE // madvise on glibc
+
+#include "packed.h"
+#include "hash_table.h"
+#include "huge.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char PACK_MAGIC[8] = {'B', 'R', 'C', 'P', 'A', 'C', 'K', '1'};
+
+typedef struct {
+  char magic[8];
+  uint64_t rows;
+  uint64_t blocks;
+  uint64_t stations;
+  uint64_t dict_offset;
+  uint64_t dict_len;
+  uint32_t block_rows;
+  uint32_t reserved[3];
+} pack_header;
+
+typedef struct {
+  uint32_t rows;
+  int16_t min;
+  int16_t max;
+} pack_block;
+
+static_assert(sizeof(pack_header) == 64, "the header is written as it is");
+static_assert(sizeof(pack_block) == 8, "the block header is written as it is");
+
+// bytes of a block of n rows
+static inline size_t _pack_block_size(size_t n) {
+  return sizeof(pack_block) + n * (sizeof(uint16_t) + sizeof(int16_t));
+}
+
+struct pack_writer {
+  FILE *out;
+  char *path;
+  char *tmp;
+  ht *ids; // name to id + 1
+  size_t stations;
+  uint64_t rows;
+  uint64_t blocks;
+
+  // the block being filled
+  pack_block block;
+  uint16_t id[PACK_BLOCK_ROWS];
+  int16_t temp[PACK_BLOCK_ROWS];
+};
+
+pack_writer *pack_create(const char *path) {
+  if (path == NULL) {
+    return NULL;
+  }
+  pack_writer *w = calloc(1, sizeof(pack_writer));
+  if (w == NULL) {
+    return NULL;
+  }
+  size_t len = strlen(path);
+  w->path = malloc(len + 1);
+  w->tmp = malloc(len + 5);
+  w->ids = ht_create();
+  if (w->path == NULL || w->tmp == NULL || w->ids == NULL) {
+    pack_discard(&w);
+    return NULL;
+  }
+  memcpy(w->path, path, len + 1);
+  memcpy(w->tmp, path, len);
+  memcpy(w->tmp + len, ".tmp", 5);
+
+  // the header is rewritten once the counts are known
+  pack_header h = {0};
+  w->out = fopen(w->tmp, "wb");
+  if (w->out == NULL || fwrite(&h, sizeof(h), 1, w->out) != 1) {
+    pack_discard(&w);
+    return NULL;
+  }
+  w->block = (pack_block){.min = INT16_MAX, .max = INT16_MIN};
+  return w;
+}
+
+static int _pack_flush(pack_writer *w) {
+  size_t n = w->block.rows;
+  if (n == 0) {
+    return 0;
+  }
+  if (fwrite(&w->block, sizeof(w->block), 1, w->out) != 1 ||
+      fwrite(w->id, sizeof(uint16_t), n, w->out) != n ||
+      fwrite(w->temp, sizeof(int16_t), n, w->out) != n) {
+    return 1;
+  }
+  w->blocks++;
+  w->block = (pack_block){.min = INT16_MAX, .max = INT16_MIN};
+  return 0;
+}
+
+int pack_add(pack_writer *w, str name, int16_t temp) {
+  if (w == NULL || !is_valid_str(name) || name.len > UINT32_MAX) {
+    return 2;
+  }
+  uintptr_t id = (uintptr_t)ht_search(w->ids, name);
+  if (id == 0) {
+    if (w->stations == PACK_MAX_STATIONS) {
+      return 1;
+    }
+    id = ++w->stations;
+    if (ht_insert(w->ids, name, (void *)id) != 0) {
+      return 2;
+    }
+  }
+
+  size_t i = w->block.rows++;
+  w->id[i] = (uint16_t)(id - 1);
+  w->temp[i] = temp;
+  w->block.min = temp < w->block.min ? temp : w->block.min;
+  w->block.max = temp > w->block.max ? temp : w->block.max;
+  w->rows++;
+  return w->block.rows == PACK_BLOCK_ROWS ? _pack_flush(w) : 0;
+}
+
+// the dictionary in id order, its length in *len
+static int _pack_write_names(pack_writer *w, uint64_t *len) {
+  str *names = calloc(w->stations ? w->stations : 1, sizeof(str));
+  if (names == NULL) {
+    return 1;
+  }
+  for (ht_iter it = ht_iterator(w->ids); it.key; it = ht_next(it)) {
+    names[(uintptr_t)it.value - 1] = *it.key;
+  }
+  int err = 0;
+  *len = 0;
+  for (size_t i = 0; i < w->stations && !err; ++i) {
+    uint32_t n = (uint32_t)names[i].len;
+    err = fwrite(&n, sizeof(n), 1, w->out) != 1 ||
+          fwrite(names[i].data, 1, n, w->out) != n;
+    *len += sizeof(n) + n;
+  }
+  free(names);
+  return err;
+}
+
+int pack_finish(pack_writer **wp) {
+  if (wp == NULL || *wp == NULL) {
+    return 2;
+  }
+  pack_writer *w = *wp;
+  pack_header h = {
+      .rows = w->rows,
+      .stations = w->stations,
+      .block_rows = PACK_BLOCK_ROWS,
+  };
+  memcpy(h.magic, PACK_MAGIC, sizeof(h.magic));
+
+  int err = _pack_flush(w);
+  h.blocks = w->blocks;
+  h.dict_offset = sizeof(h) + w->rows / PACK_BLOCK_ROWS *
+                                  _pack_block_size(PACK_BLOCK_ROWS);
+  if (w->rows % PACK_BLOCK_ROWS) {
+    h.dict_offset += _pack_block_size(w->rows % PACK_BLOCK_ROWS);
+  }
+  err = err || _pack_write_names(w, &h.dict_len);
+  err = err || fseek(w->out, 0, SEEK_SET) != 0 ||
+        fwrite(&h, sizeof(h), 1, w->out) != 1;
+  err = fclose(w->out) != 0 || err;
+  w->out = NULL;
+  if (!err && rename(w->tmp, w->path) == 0) {
+    free(w->tmp);
+    w->tmp = NULL;
+  } else {
+    err = 1;
+  }
+  pack_discard(wp);
+  return err;
+}
+
+void pack_discard(pack_writer **wp) {
+  if (wp == NULL || *wp == NULL) {
+    return;
+  }
+  pack_writer *w = *wp;
+  if (w->out) {
+    fclose(w->out);
+  }
+  if (w->tmp) {
+    remove(w->tmp);
+  }
+  ht_destroy(&w->ids);
+  free(w->tmp);
+  free(w->path);
+  free(w);
+  *wp = NULL;
+}
+
+// rows in block b
+static inline size_t _pack_rows_in(const pack_file *f, size_t b) {
+  return b + 1 < f->blocks ? f->_block_rows
+                           : f->rows - (uint64_t)b * f->_block_rows;
+}
+
+static inline const unsigned char *_pack_block_at(const pack_file *f,
+                                                  size_t b) {
+  return f->_map + sizeof(pack_header) + b * _pack_block_size(f->_block_rows);
+}
+
+// every count and offset in h agrees with a file of len bytes. rows and
+// block_rows are bounded by what len can hold first, the sizes computed
+// from them can't wrap then
+static bool _pack_header_ok(const pack_header *h, size_t len) {
+  if (memcmp(h->magic, PACK_MAGIC, sizeof(h->magic)) != 0 ||
+      h->block_rows == 0 || h->block_rows > PACK_BLOCK_ROWS ||
+      h->rows > len / (sizeof(uint16_t) + sizeof(int16_t)) ||
+      h->stations > PACK_MAX_STATIONS ||
+      h->blocks != (h->rows + h->block_rows - 1) / h->block_rows) {
+    return false;
+  }
+  uint64_t data = h->rows / h->block_rows * _pack_block_size(h->block_rows);
+  if (h->rows % h->block_rows) {
+    data += _pack_block_size(h->rows % h->block_rows);
+  }
+  return h->dict_offset == sizeof(pack_header) + data &&
+         h->dict_len <= len && h->dict_offset == len - h->dict_len;
+}
+
+static int _pack_read_names(pack_file *f, const pack_header *h) {
+  f->names = calloc(h->stations ? h->stations : 1, sizeof(str));
+  if (f->names == NULL) {
+    return 1;
+  }
+  const unsigned char *p = f->_map + h->dict_offset;
+  const unsigned char *end = f->_map + f->_map_len;
+  for (size_t i = 0; i < h->stations; ++i) {
+    uint32_t n;
+    if (end - p < (ptrdiff_t)sizeof(n)) {
+      return 1;
+    }
+    memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+    if (n == 0 || end - p < (ptrdiff_t)n) {
+      return 1;
+    }
+    f->names[i] = (str){.data = (unsigned char *)p, .len = n};
+    p += n;
+  }
+  return p != end;
+}
+
+int pack_open(const char *path, pack_file *f) {
+  if (path == NULL || f == NULL) {
+    return 1;
+  }
+  *f = (pack_file){0};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      (size_t)st.st_size < sizeof(pack_header)) {
+    close(fd);
+    return 1;
+  }
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return 1;
+  }
+  // hints only, failure is harmless
+  madvise(map, len, MADV_WILLNEED);
+  huge_advise(map, len);
+  f->_map = map;
+  f->_map_len = len;
+
+  pack_header h;
+  memcpy(&h, map, sizeof(h));
+  if (!_pack_header_ok(&h, len) || _pack_read_names(f, &h) != 0) {
+    pack_close(f);
+    return 1;
+  }
+  f->rows = h.rows;
+  f->blocks = h.blocks;
+  f->stations = h.stations;
+  f->_block_rows = h.block_rows;
+  return 0;
+}
+
+void pack_close(pack_file *f) {
+  if (f == NULL) {
+    return;
+  }
+  if (f->_map) {
+    munmap((void *)f->_map, f->_map_len);
+  }
+  free(f->names);
+  *f = (pack_file){0};
+}
+
+pack_stat *pack_stats_create(size_t n) {
+  pack_stat *s = malloc((n ? n : 1) * sizeof(pack_stat));
+  if (s == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    s[i] = (pack_stat){.min = INT16_MAX, .max = INT16_MIN};
+  }
+  return s;
+}
+
+int64_t pack_aggregate(const pack_file *f, size_t b, pack_stat *stats) {
+  if (f == NULL || stats == NULL || b >= f->blocks) {
+    return -1;
+  }
+  const unsigned char *p = _pack_block_at(f, b);
+  pack_block h;
+  memcpy(&h, p, sizeof(h));
+  size_t n = _pack_rows_in(f, b);
+  if (h.rows != n) {
+    return -1;
+  }
+  const uint16_t *id = (const uint16_t *)(p + sizeof(h));
+  const int16_t *temp = (const int16_t *)(id + n);
+
+  // one branch free pass to check the ids, the loop below trusts them
+  uint16_t top = 0;
+  for (size_t i = 0; i < n; ++i) {
+    top = id[i] > top ? id[i] : top;
+  }
+  if (n && top >= f->stations) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    pack_stat *s = &stats[id[i]];
+    int16_t t = temp[i];
+    s->sum += t;
+    s->count += 1;
+    s->min = t < s->min ? t : s->min;
+    s->max = t > s->max ? t : s->max;
+  }
+  return (int64_t)n;
+}
+
+void pack_stats_merge(pack_stat *dst, const pack_stat *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i].sum += src[i].sum;
+    dst[i].count += src[i].count;
+    dst[i].min = src[i].min < dst[i].min ? src[i].min : dst[i].min;
+    dst[i].max = src[i].max > dst[i].max ? src[i].max : dst[i].max;
+  }
+}
+
+int pack_export(const pack_file *f, const pack_stat *stats, stats_table *dst) {
+  if (f == NULL || stats == NULL || dst == NULL) {
+    return 2;
+  }
+  for (size_t i = 0; i < f->stations; ++i) {
+    if (stats[i].count == 0) {
+      continue;
+    }
+    str key = f->names[i];
+    st_slot slot = {.hash = st_hash(key),
+                    .sum = stats[i].sum,
+                    .count = stats[i].count,
+                    .min = stats[i].min,
+                    .max = stats[i].max,
+                    .len = (uint32_t)key.len};
+    if (key.len > ST_INLINE_KEY) {
+      slot.ext = key.data;
+    } else {
+      memcpy(slot.key, key.data, key.len);
+    }
+    if (st_merge_slot(dst, &slot) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
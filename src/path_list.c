@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L // strdup, glob and dirent
+
+#include "path_list.h"
+#include <dirent.h>
+#include <glob.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// takes a copy of path, non-zero on error
+static int _path_list_add(path_list *l, size_t *cap, const char *path) {
+  if (l->count == *cap) {
+    size_t n = *cap ? *cap * 2 : 16;
+    char **grown = realloc(l->paths, n * sizeof(char *));
+    if (grown == NULL) {
+      return 1;
+    }
+    l->paths = grown;
+    *cap = n;
+  }
+  char *copy = strdup(path);
+  if (copy == NULL) {
+    return 1;
+  }
+  l->paths[l->count++] = copy;
+  return 0;
+}
+
+static bool _is_file(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static int _path_cmp(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int _path_list_dir(path_list *l, size_t *cap, const char *dir) {
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    return 1;
+  }
+  size_t first = l->count;
+  size_t len = strlen(dir);
+  bool slash = len && dir[len - 1] == '/';
+  int err = 0;
+  struct dirent *e;
+  while (!err && (e = readdir(d))) {
+    if (e->d_name[0] == '.') {
+      continue;
+    }
+    char *path = malloc(len + strlen(e->d_name) + 2);
+    if (path == NULL) {
+      err = 1;
+      break;
+    }
+    strcpy(path, dir);
+    strcpy(path + len, slash ? "" : "/");
+    strcat(path, e->d_name);
+    if (_is_file(path)) {
+      err = _path_list_add(l, cap, path);
+    }
+    free(path);
+  }
+  closedir(d);
+  qsort(l->paths + first, l->count - first, sizeof(char *), _path_cmp);
+  return err || l->count == first;
+}
+
+// the regular files among the matches, like _path_list_dir
+static int _path_list_glob(path_list *l, size_t *cap, const char *pattern) {
+  glob_t g;
+  if (glob(pattern, 0, NULL, &g) != 0) {
+    return 1;
+  }
+  size_t first = l->count;
+  int err = 0;
+  for (size_t i = 0; i < g.gl_pathc && !err; ++i) {
+    if (_is_file(g.gl_pathv[i])) {
+      err = _path_list_add(l, cap, g.gl_pathv[i]);
+    }
+  }
+  globfree(&g);
+  return err || l->count == first;
+}
+
+int path_list_expand(char **args, size_t n, path_list *out) {
+  if (out == NULL) {
+    return 1;
+  }
+  *out = (path_list){0};
+  size_t cap = 0;
+  int err = 0;
+  for (size_t i = 0; i < n && !err; ++i) {
+    struct stat st;
+    bool exists = stat(args[i], &st) == 0;
+    if (exists && S_ISDIR(st.st_mode)) {
+      err = _path_list_dir(out, &cap, args[i]);
+    } else if (!exists && strpbrk(args[i], "*?[")) {
+      err = _path_list_glob(out, &cap, args[i]);
+    } else {
+      err = _path_list_add(out, &cap, args[i]);
+    }
+  }
+  if (err) {
+    path_list_free(out);
+  }
+  return err;
+}
+
+void path_list_free(path_list *l) {
+  if (l == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < l->count; ++i) {
+    free(l->paths[i]);
+  }
+  free(l->paths);
+  *l = (path_list){0};
+}
@@ -0,0 +1,209 @@
+#define _GNU_SOURCE // syscall and clock_gettime on glibc
+
+#include "prof.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *PROF_NAMES[PROF_EVENTS] = {
+    [PROF_CYCLES] = "cycles",
+    [PROF_INSTRUCTIONS] = "instructions",
+    [PROF_CACHE_MISSES] = "cache_misses",
+    [PROF_BRANCH_MISSES] = "branch_misses",
+};
+
+int prof_parse(const char *spec, prof_config *config) {
+  *config = (prof_config){.format = PROF_TEXT};
+  while (*spec) {
+    size_t len = strcspn(spec, ",");
+    if (len == 4 && strncmp(spec, "text", 4) == 0) {
+      config->format = PROF_TEXT;
+    } else if (len == 4 && strncmp(spec, "json", 4) == 0) {
+      config->format = PROF_JSON;
+    } else if (len == 8 && strncmp(spec, "counters", 8) == 0) {
+      config->counters = true;
+    } else {
+      return 1;
+    }
+    spec += len + (spec[len] == ',');
+  }
+  return 0;
+}
+
+#if defined(__linux__)
+static int _prof_event_open(prof_event e) {
+  static const uint64_t configs[PROF_EVENTS] = {
+      [PROF_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+      [PROF_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+      [PROF_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+      [PROF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+  };
+  struct perf_event_attr attr = {0};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = configs[e];
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // this thread, any cpu, counting from the moment it is opened
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#else
+static int _prof_event_open(prof_event e) {
+  (void)e;
+  return -1;
+}
+#endif
+
+int prof_open(prof_counters *c, bool enabled) {
+  for (int i = 0; i < PROF_EVENTS; ++i) {
+    c->fd[i] = -1;
+  }
+  if (!enabled) {
+    return 0;
+  }
+  for (int i = 0; i < PROF_EVENTS; ++i) {
+    c->fd[i] = _prof_event_open(i);
+    if (c->fd[i] < 0) {
+      // all or nothing, a partial set only confuses the report
+      prof_close(c);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void prof_close(prof_counters *c) {
+  for (int i = 0; i < PROF_EVENTS; ++i) {
+    if (c->fd[i] >= 0) {
+      close(c->fd[i]);
+    }
+    c->fd[i] = -1;
+  }
+}
+
+static inline bool _prof_counting(const prof_counters *c) {
+  return c && c->fd[0] >= 0;
+}
+
+prof_sample prof_now(const prof_counters *c) {
+  prof_sample s = {0};
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  s.wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+  if (_prof_counting(c)) {
+    for (int i = 0; i < PROF_EVENTS; ++i) {
+      if (read(c->fd[i], &s.events[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+        s.events[i] = 0;
+      }
+    }
+  }
+  return s;
+}
+
+void prof_add(prof_span *s, const prof_counters *c, prof_sample from,
+              prof_sample to) {
+  s->wall += to.wall - from.wall;
+  if (_prof_counting(c)) {
+    for (int i = 0; i < PROF_EVENTS; ++i) {
+      s->events[i] += to.events[i] - from.events[i];
+    }
+    s->counted = true;
+  }
+}
+
+void prof_sum(prof_span *a, const prof_span *b) {
+  // an empty a takes on whatever b has
+  bool fresh = a->wall == 0 && !a->counted;
+  a->wall += b->wall;
+  for (int i = 0; i < PROF_EVENTS; ++i) {
+    a->events[i] += b->events[i];
+  }
+  a->counted = b->counted && (a->counted || fresh);
+}
+
+// one table line, rows < 0 leaves the rows column blank
+static void _prof_text(FILE *out, const char *name, long long rows,
+                       const prof_span *s) {
+  char count[24] = "";
+  if (rows >= 0) {
+    snprintf(count, sizeof(count), "%lld", rows);
+  }
+  fprintf(out, "%-10s %12s %10.3f", name, count, s->wall * 1e3);
+  if (s->counted) {
+    for (int i = 0; i < PROF_EVENTS; ++i) {
+      fprintf(out, " %14llu", (unsigned long long)s->events[i]);
+    }
+    double ipc = s->events[PROF_CYCLES]
+                     ? (double)s->events[PROF_INSTRUCTIONS] /
+                           s->events[PROF_CYCLES]
+                     : 0.0;
+    fprintf(out, " %5.2f", ipc);
+  }
+  fputc('\n', out);
+}
+
+static void _prof_json(FILE *out, const prof_span *s) {
+  fprintf(out, "\"wall_ms\": %.3f", s->wall * 1e3);
+  if (s->counted) {
+    for (int i = 0; i < PROF_EVENTS; ++i) {
+      fprintf(out, ", \"%s\": %llu", PROF_NAMES[i],
+              (unsigned long long)s->events[i]);
+    }
+  }
+}
+
+void prof_report(FILE *out, prof_config config, const prof_phase *phases,
+                 size_t n_phases, const prof_span *threads,
+                 const int64_t *rows, size_t n_threads) {
+  bool counted = false;
+  for (size_t i = 0; i < n_phases; ++i) {
+    counted |= phases[i].span.counted;
+  }
+
+  if (config.format == PROF_JSON) {
+    fputs("{\"phases\": [", out);
+    for (size_t i = 0; i < n_phases; ++i) {
+      fprintf(out, "%s{\"name\": \"%s\", ", i ? ", " : "", phases[i].name);
+      _prof_json(out, &phases[i].span);
+      fputc('}', out);
+    }
+    fputs("], \"threads\": [", out);
+    for (size_t i = 0; i < n_threads; ++i) {
+      fprintf(out, "%s{\"thread\": %zu, ", i ? ", " : "", i);
+      if (rows) {
+        fprintf(out, "\"rows\": %lld, ", (long long)rows[i]);
+      }
+      _prof_json(out, &threads[i]);
+      fputc('}', out);
+    }
+    fprintf(out, "], \"counters\": %s}\n", counted ? "true" : "false");
+    return;
+  } else if (config.format != PROF_TEXT) {
+    return;
+  }
+
+  fprintf(out, "%-10s %12s %10s", "phase", "rows", "wall ms");
+  if (counted) {
+    for (int i = 0; i < PROF_EVENTS; ++i) {
+      fprintf(out, " %14s", PROF_NAMES[i]);
+    }
+    fprintf(out, " %5s", "ipc");
+  }
+  fputc('\n', out);
+  for (size_t i = 0; i < n_phases; ++i) {
+    _prof_text(out, phases[i].name, -1, &phases[i].span);
+  }
+  for (size_t i = 0; i < n_threads; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "thread %zu", i);
+    _prof_text(out, name, rows ? (long long)rows[i] : -1, &threads[i]);
+  }
+  if (config.counters && !counted) {
+    fputs("(no hardware counters)\n", out);
+  }
+}
@@ -1,4 +1,18 @@
 #include "q_strings.h"
+#include "hash.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define Q_VEC 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define Q_VEC 16
+#else
+#define Q_VEC 8
+#endif
+
+// byte c copied into every byte of a word
+#define SWAR_BCAST(c) (0x0101010101010101ULL * (uint64_t)(c))
 
 bool are_equal(str a, str b) {
   if (a.len != b.len) {
@@ -26,10 +40,7 @@ snip cut(str s, char c) {
 
   unsigned char *beggining = s.data;
   unsigned char *end = s.data + s.len;
-  unsigned char *cut = beggining;
-
-  for (; cut < end && *cut != c; cut++)
-    ;
+  unsigned char *cut = beggining + find_byte(beggining, s.len, c);
 
   n.ok = cut < end;
   n.head = slice(beggining, cut);
@@ -44,3 +55,176 @@ snip cut(str s, char c) {
 inline bool is_valid_str(str a) {
   return a.len && a.data; 
 }
+
+/*
+
+  swar: for each byte x of the word, the high bit of
+  ~(((x & 0x7f) + 0x7f) | x) is set only when x == 0. xoring with the
+  broadcast delimiter first turns matches into zero bytes. unlike the
+  classic haszero trick there is no borrow between bytes, so every bit is
+  exact and can be turned into a mask.
+
+*/
+static inline uint64_t _swar_match(uint64_t word, uint64_t pattern) {
+  uint64_t x = word ^ pattern;
+  uint64_t lo = 0x7f7f7f7f7f7f7f7fULL;
+  return ~(((x & lo) + lo) | x | lo);
+}
+
+// high bit of each byte packed into the low 8 bits, byte 0 -> bit 0
+static inline uint64_t _swar_pack(uint64_t m) {
+  return ((m >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+// little endian load that is fine with unaligned pointers
+static inline uint64_t _load64(const unsigned char *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+// bitmask of the bytes equal to c in the Q_VEC bytes at p
+static inline uint64_t _match(const unsigned char *p, unsigned char c) {
+#if defined(__AVX2__)
+  __m256i v = _mm256_loadu_si256((const __m256i *)p);
+  __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)c));
+  return (uint32_t)_mm256_movemask_epi8(m);
+#elif defined(__SSE2__)
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8((char)c));
+  return (uint32_t)_mm_movemask_epi8(m);
+#else
+  return _swar_pack(_swar_match(_load64(p), SWAR_BCAST(c)));
+#endif
+}
+
+ptrdiff_t find_byte(const unsigned char *p, ptrdiff_t n, unsigned char c) {
+  ptrdiff_t i = 0;
+  for (; i + Q_VEC <= n; i += Q_VEC) {
+    uint64_t m = _match(p + i, c);
+    if (m) {
+      return i + __builtin_ctzll(m);
+    }
+  }
+  // never load past the end, finish the tail a byte at a time
+  for (; i < n && p[i] != c; i++)
+    ;
+  return i;
+}
+
+delims scan_delims(str s) {
+  delims d = {0};
+  if (!s.data || s.len <= 0) {
+    return d;
+  }
+
+  const unsigned char *p = s.data;
+  unsigned char pad[DELIM_BLOCK];
+  if (s.len < DELIM_BLOCK) {
+    // short block, scan a zero padded copy so loads stay in bounds
+    memset(pad, 0, sizeof(pad));
+    memcpy(pad, s.data, s.len);
+    p = pad;
+  }
+
+  for (int i = 0; i < DELIM_BLOCK; i += Q_VEC) {
+    d.semi |= _match(p + i, ';') << i;
+    d.nl |= _match(p + i, '\n') << i;
+  }
+  return d;
+}
+
+/*
+
+  swar temperature parse, all four shapes fit in one little endian word:
+  X.X  XX.X  -X.X  -XX.X
+
+  - of the bytes that can hold the '.', only it has bit 4 clear, so the
+    lowest set bit of ~word & 0x10101000 gives its position
+  - '-' also has bit 4 clear, moving bit 4 of byte 0 to the top and
+    shifting it back down arithmetically gives a 0 or -1 sign mask
+  - after masking off the sign and shifting so the '.' always sits in
+    byte 3, the digits are at bytes 1, 2 and 4 (byte 1 is 0 for one
+    leading digit), one multiply by 100 << 24 | 10 << 16 | 1 sums them
+    with their weights into bits 32..41
+
+*/
+int16_t parse_tenths_at(const unsigned char *p, ptrdiff_t *len) {
+  uint64_t word = _load64(p);
+  int dot = __builtin_ctzll(~word & 0x10101000ULL);
+  int shift = 28 - dot;
+  int64_t sign = (int64_t)(~word << 59) >> 63;
+  uint64_t unsigned_word = word & ~((uint64_t)sign & 0xFF);
+  uint64_t digits = (unsigned_word << shift) & 0x0F000F0F00ULL;
+  int64_t abs = (int64_t)(((digits * 0x640a0001ULL) >> 32) & 0x3FF);
+
+  if (len) {
+    *len = (dot >> 3) + 2;
+  }
+  return (int16_t)((abs ^ sign) - sign);
+}
+
+int16_t parse_tenths(str s, ptrdiff_t *len) {
+  unsigned char pad[8] = {0};
+  const unsigned char *p = s.data;
+  if (s.len < 8) {
+    // don't read past the end of a short buffer
+    memcpy(pad, s.data, s.len > 0 ? s.len : 0);
+    p = pad;
+  }
+  return parse_tenths_at(p, len);
+}
+
+int64_t mean_tenths(int64_t sum, int64_t count) {
+  // floor((sum / count) + 1/2) without leaving integers
+  int64_t n = 2 * sum + count;
+  int64_t d = 2 * count;
+  int64_t q = n / d;
+  if (n % d != 0 && n < 0) {
+    q -= 1;
+  }
+  return q;
+}
+
+snip cut_hash(str s, char c, uint64_t *hash) {
+  snip n = {0};
+  if (s.len <= 0 || !s.data) {
+    return n;
+  }
+
+  uint64_t pattern = SWAR_BCAST(c);
+  uint64_t h = HASH_SEED;
+  ptrdiff_t i = 0;
+  ptrdiff_t at = s.len;
+  uint64_t last = 0;
+  for (; i + 8 <= s.len; i += 8) {
+    uint64_t w = _load64(s.data + i);
+    uint64_t m = _swar_match(w, pattern);
+    if (m) {
+      // bytes of the word before the delimiter, zero padded
+      int bytes = __builtin_ctzll(m) >> 3;
+      at = i + bytes;
+      last = bytes ? w & (~0ULL >> (64 - 8 * bytes)) : 0;
+      break;
+    }
+    h = hash_word(h, w);
+  }
+  if (at == s.len && i < s.len) {
+    // fewer than 8 bytes left, finish on a padded copy
+    ptrdiff_t left = s.len - i;
+    uint64_t w = 0;
+    memcpy(&w, s.data + i, left);
+    uint64_t m = _swar_match(w, pattern) & (~0ULL >> (64 - 8 * left));
+    int bytes = m ? __builtin_ctzll(m) >> 3 : (int)left;
+    at = i + bytes;
+    last = bytes ? w & (~0ULL >> (64 - 8 * bytes)) : 0;
+  }
+
+  n.ok = at < s.len;
+  n.head = slice(s.data, s.data + at);
+  n.tail = slice(s.data + (n.ok ? at + 1 : at), s.data + s.len);
+  if (hash) {
+    *hash = hash_finish(hash_word(h, last), (size_t)at);
+  }
+  return n;
+}
@@ -0,0 +1,464 @@
+#define _GNU_SOURCE // getline, fdopen and nanosleep on glibc
+
+#include "checkpoint.h"
+#include "input.h"
+#include "output.h"
+#include "q_strings.h"
+#include "schema.h"
+#include "snapshot.h"
+#include "stats_table.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+
+  keeps the aggregates of an append only measurements file in memory and
+  answers queries about them on a unix socket.
+
+    server <file> <socket> [--interval-ms=N] [--readers=N]
+
+  the main thread ingests: it parses the file once, then every interval
+  whatever complete lines were appended since, and publishes a new
+  snapshot when anything changed. a file that was rewritten, truncated
+  or replaced is ingested again from the start, the same test
+  --checkpoint uses. reader threads each serve one connection at a time
+  from the snapshot current when a query arrives, see snapshot.h, so a
+  query never waits on ingestion or the other way round.
+
+  a query is one line, every answer ends with an empty line:
+    GET <name>            name=min/mean/max
+    PREFIX <prefix>       one such line per station starting with prefix
+    TOP <k> MEAN|MAX      the k stations with the highest mean or max
+    DUMP                  {name=min/mean/max, ...} as multithreaded prints
+    INFO                  rows=N stations=N generation=N
+  anything else is answered with a line starting with ERR.
+
+*/
+
+#define INTERVAL_MS 1000
+#define READERS 4
+
+// sized for the 10k station variant so the table never grows mid run
+#define STATIONS_HINT 10000
+
+// a client that sends nothing for this long is dropped
+#define IDLE_S 30
+
+typedef struct {
+  const char *path;
+  const char *socket;
+  long interval_ms;
+  long readers;
+} options;
+
+// written by the signal handler, read by the ingest loop
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig) {
+  (void)sig;
+  stopping = 1;
+}
+
+// the ingesting thread's state
+typedef struct {
+  const char *path;
+  stats_table *table;
+  ckpt_ident seen; // offset is 0 until the first ingest
+  uint64_t rows;
+  uint64_t generation;
+} ingest_state;
+
+/*
+
+  adds the complete lines appended since the last call, or all of them if
+  the file changed under us. they are parsed into a table of their own
+  first, a malformed row leaves the state as it was. 1 when there was
+  something new, 0 when not, -1 on error
+
+*/
+static int ingest(ingest_state *st) {
+  input in;
+  // an mmap per round, there is no need to read ahead of the parse
+  if (input_open_with(st->path, &in, false) != 0) {
+    return -1;
+  }
+  bool restart =
+      st->seen.offset && !ckpt_matches(&st->seen, st->path, in.data);
+  ptrdiff_t from = restart ? 0 : (ptrdiff_t)st->seen.offset;
+  if (!restart && in.data.len == from) {
+    input_close(&in);
+    return 0;
+  }
+
+  stats_table *fresh = st_create(restart ? STATIONS_HINT : 0);
+  str rest = slice(in.data.data + from, in.data.data + in.data.len);
+  uint64_t rows = 0;
+  int err = fresh == NULL;
+  while (!err && rest.len) {
+    row r;
+    ptrdiff_t len = parse_row(rest, &r);
+    if (len == 0) {
+      fprintf(stderr, "malformed row at byte %td\n",
+              rest.data - in.data.data);
+      err = 1;
+      break;
+    }
+    err = st_add_hashed(fresh, r.name, r.hash, r.temp) != 0;
+    rest = slice(rest.data + len, rest.data + rest.len);
+    rows++;
+  }
+
+  if (!err && restart) {
+    st_destroy(&st->table);
+    st->table = fresh;
+    fresh = NULL;
+    st->rows = 0;
+  } else if (!err) {
+    err = st_merge(st->table, fresh) != 0;
+  }
+  if (!err) {
+    st->rows += rows;
+    err = ckpt_identify(st->path, in.data, &st->seen) != 0;
+  }
+  st_destroy(&fresh);
+  input_close(&in);
+  return err ? -1 : 1;
+}
+
+static void put_slot(FILE *out, st_slot *s) {
+  unsigned char buf[3 * 21 + 2];
+  unsigned char *p = buf;
+  str name = st_key(s);
+  fwrite(name.data, 1, name.len, out);
+  *p++ = '=';
+  p += format_tenths(p, s->min);
+  *p++ = '/';
+  p += format_tenths(p, mean_tenths(s->sum, s->count));
+  *p++ = '/';
+  p += format_tenths(p, s->max);
+  *p++ = '\n';
+  fwrite(buf, 1, p - buf, out);
+}
+
+// the argument after a command word, or an invalid str
+static str argument(str line, const char *word) {
+  size_t n = strlen(word);
+  if ((size_t)line.len > n && memcmp(line.data, word, n) == 0 &&
+      line.data[n] == ' ') {
+    return slice(line.data + n + 1, line.data + line.len);
+  }
+  return (str){0};
+}
+
+// writes the answer to one query, without its closing empty line
+static void answer(FILE *out, const snapshot *s, str line) {
+  str arg;
+  if (is_valid_str(arg = argument(line, "GET"))) {
+    st_slot *slot = snap_get(s, arg);
+    if (slot) {
+      put_slot(out, slot);
+    } else {
+      fputs("ERR no such station\n", out);
+    }
+  } else if (are_equal(line, S("PREFIX")) ||
+             is_valid_str(arg = argument(line, "PREFIX"))) {
+    size_t first = 0;
+    size_t n = snap_prefix(s, arg, &first);
+    for (size_t i = first; i < first + n; ++i) {
+      put_slot(out, s->by_name[i]);
+    }
+  } else if (is_valid_str(arg = argument(line, "TOP"))) {
+    char by[8] = "";
+    unsigned long k = 0;
+    char tail;
+    char spec[64];
+    size_t n = (size_t)arg.len < sizeof(spec) ? (size_t)arg.len
+                                              : sizeof(spec) - 1;
+    memcpy(spec, arg.data, n);
+    spec[n] = '\0';
+    if (sscanf(spec, "%lu %7s %c", &k, by, &tail) != 2 ||
+        (strcmp(by, "MEAN") != 0 && strcmp(by, "MAX") != 0)) {
+      fputs("ERR usage: TOP <k> MEAN|MAX\n", out);
+      return;
+    }
+    st_slot **order = by[1] == 'E' ? s->by_mean : s->by_max;
+    for (size_t i = 0; i < k && i < s->count; ++i) {
+      put_slot(out, order[i]);
+    }
+  } else if (are_equal(line, S("DUMP"))) {
+    fwrite(s->dump.data, 1, s->dump.len, out);
+  } else if (are_equal(line, S("INFO"))) {
+    fprintf(out, "rows=%llu stations=%zu generation=%llu\n",
+            (unsigned long long)s->rows, s->count,
+            (unsigned long long)s->generation);
+  } else {
+    fputs("ERR unknown query\n", out);
+  }
+}
+
+/*
+
+  conn and closing are only touched under lock. a reader publishes the
+  client it accepted unless main is already closing, and takes it back
+  before the fd is closed, so main's shutdown at exit always reaches a
+  live client and never an fd number that has been reused
+
+*/
+typedef struct {
+  int listener;
+  snap_pub *pub;
+  size_t id; // the hazard slot this thread reads through
+  pthread_mutex_t lock;
+  int conn;     // the client being served, -1 between clients
+  bool closing; // set by main on its way out
+} reader;
+
+// a FILE on a dup of fd, null on error
+static FILE *open_dup(int fd, const char *mode) {
+  int d = dup(fd);
+  FILE *f = d >= 0 ? fdopen(d, mode) : NULL;
+  if (f == NULL && d >= 0) {
+    close(d);
+  }
+  return f;
+}
+
+// answers queries on fd until the client hangs up, fd itself stays open
+static void serve(reader *r, int fd) {
+  struct timeval idle = {.tv_sec = IDLE_S};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+  FILE *in = open_dup(fd, "r");
+  FILE *out = open_dup(fd, "w");
+  if (in == NULL || out == NULL) {
+    if (in) {
+      fclose(in);
+    }
+    if (out) {
+      fclose(out);
+    }
+    return;
+  }
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t n;
+  while ((n = getline(&line, &cap, in)) > 0) {
+    str q = {.data = (unsigned char *)line, .len = n};
+    while (q.len && (line[q.len - 1] == '\n' || line[q.len - 1] == '\r')) {
+      q.len--;
+    }
+    snapshot *s = snap_acquire(r->pub, r->id);
+    answer(out, s, q);
+    snap_release(r->pub, r->id);
+    fputc('\n', out);
+    if (fflush(out) != 0) {
+      break;
+    }
+  }
+  free(line);
+  fclose(out);
+  fclose(in);
+}
+
+// thread function, one connection at a time until the listener is shut
+static void *reader_run(void *arg) {
+  reader *r = arg;
+  for (;;) {
+    int fd = accept(r->listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break;
+    }
+    pthread_mutex_lock(&r->lock);
+    bool closing = r->closing;
+    r->conn = closing ? -1 : fd;
+    pthread_mutex_unlock(&r->lock);
+    if (closing) {
+      close(fd);
+      break;
+    }
+    serve(r, fd);
+    pthread_mutex_lock(&r->lock);
+    r->conn = -1;
+    pthread_mutex_unlock(&r->lock);
+    close(fd);
+  }
+  return r;
+}
+
+// a listening socket at path, replacing a stale one, -1 on error
+static int listen_at(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 64) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// builds and publishes a snapshot of the ingested table, non-zero on error
+static int publish(snap_pub *pub, ingest_state *st) {
+  snapshot *s = snap_build(st->table, st->rows, ++st->generation);
+  if (s == NULL) {
+    return 1;
+  }
+  snap_publish(pub, s);
+  return 0;
+}
+
+// non-zero on bad arguments
+static int parse_options(int argc, char **argv, options *o) {
+  *o = (options){.interval_ms = INTERVAL_MS, .readers = READERS};
+  int positional = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--interval-ms=", 14) == 0) {
+      o->interval_ms = atol(argv[i] + 14);
+      if (o->interval_ms <= 0) {
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--readers=", 10) == 0) {
+      o->readers = atol(argv[i] + 10);
+      if (o->readers <= 0 || o->readers > SNAP_READERS) {
+        return 1;
+      }
+    } else if (argv[i][0] == '-') {
+      return 1;
+    } else if (positional == 0) {
+      o->path = argv[i];
+      positional++;
+    } else if (positional == 1) {
+      o->socket = argv[i];
+      positional++;
+    } else {
+      return 1;
+    }
+  }
+  return positional != 2;
+}
+
+int main(int argc, char **argv) {
+  options o;
+  if (parse_options(argc, argv, &o) != 0) {
+    fprintf(stderr,
+            "usage: %s <file> <socket> [--interval-ms=N] [--readers=1..%d]\n",
+            argv[0], SNAP_READERS);
+    return EXIT_FAILURE;
+  }
+
+  struct sigaction sa = {.sa_handler = on_signal};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  // a client that hangs up mid answer is only that client's problem
+  signal(SIGPIPE, SIG_IGN);
+
+  ingest_state st = {.path = o.path, .table = st_create(STATIONS_HINT)};
+  snap_pub *pub = malloc(sizeof(snap_pub));
+  if (st.table == NULL || pub == NULL) {
+    st_destroy(&st.table);
+    free(pub);
+    return EXIT_FAILURE;
+  }
+  snap_pub_init(pub);
+  if (ingest(&st) < 0 || publish(pub, &st) != 0) {
+    fputs("Failed to ingest input.\n", stderr);
+    snap_pub_destroy(pub);
+    free(pub);
+    st_destroy(&st.table);
+    return EXIT_FAILURE;
+  }
+
+  int listener = listen_at(o.socket);
+  if (listener < 0) {
+    perror("Failed to listen.");
+    snap_pub_destroy(pub);
+    free(pub);
+    st_destroy(&st.table);
+    return EXIT_FAILURE;
+  }
+
+  reader *readers = calloc(o.readers, sizeof(reader));
+  pthread_t *threads = calloc(o.readers, sizeof(pthread_t));
+  long started = 0;
+  for (long i = 0; readers && threads && i < o.readers; ++i) {
+    readers[i] =
+        (reader){.listener = listener, .pub = pub, .id = i, .conn = -1};
+    if (pthread_mutex_init(&readers[i].lock, NULL) != 0) {
+      break;
+    }
+    if (pthread_create(&threads[i], NULL, reader_run, &readers[i]) != 0) {
+      pthread_mutex_destroy(&readers[i].lock);
+      break;
+    }
+    started++;
+  }
+  int err = started == 0;
+
+  struct timespec interval = {.tv_sec = o.interval_ms / 1000,
+                              .tv_nsec = o.interval_ms % 1000 * 1000000};
+  bool failing = false;
+  while (!err && !stopping) {
+    nanosleep(&interval, NULL);
+    if (stopping) {
+      break;
+    }
+    int changed = ingest(&st);
+    // say it once per run of failures, they usually repeat every round
+    if (changed < 0 && !failing) {
+      fputs("Failed to ingest appended rows, serving the last snapshot.\n",
+            stderr);
+    }
+    failing = changed < 0;
+    if (changed > 0 && publish(pub, &st) != 0) {
+      fputs("Failed to publish a snapshot.\n", stderr);
+    }
+  }
+
+  // wakes the readers blocked in accept, and in a read from a client
+  shutdown(listener, SHUT_RDWR);
+  for (long i = 0; i < started; ++i) {
+    pthread_mutex_lock(&readers[i].lock);
+    readers[i].closing = true;
+    if (readers[i].conn >= 0) {
+      shutdown(readers[i].conn, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&readers[i].lock);
+  }
+  for (long i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&readers[i].lock);
+  }
+  close(listener);
+  unlink(o.socket);
+  free(threads);
+  free(readers);
+  snap_pub_destroy(pub);
+  free(pub);
+  st_destroy(&st.table);
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
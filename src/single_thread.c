@@ -1,7 +1,16 @@
+#include "chunk_reader.h"
+#include "output.h"
+#include "path_list.h"
+#include "q_strings.h"
+#include "schema.h"
+#include "stats_table.h"
+#include <fcntl.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #define macro_var(name) concat(name, __LINE__)
 
@@ -15,138 +24,88 @@
   !macro_var(_i_); \
   (macro_var(_i_) += 1), end) \
 
-#define LINE_LEN 1024
-#define NAME_MAX 100
-#define TEMP_MAX 100
-#define MAX_PLACES 1000
 #define BUFF_SIZE 16*1024*1024 // 16 MB, L3 cache on M2 is 16 mb
 //#define BUFF_SIZE 30
 
+// sized for the 10k station variant so the table never grows mid run
+#define STATIONS_HINT 10000
+
 #define TRUE 1
 #define FALSE 0
 
-typedef struct entry_t entry_t;
-struct entry_t {
-  float sum;
-  float min;
-  float max;
-  size_t n_temps;
-  char name[NAME_MAX];
-};
-
-static inline int entry_cmp(const void *key, const void *element) {
-  // want NULL named entries to the right side of array
-  return strcmp(((entry_t*)key)->name, ((entry_t*)element)->name);
-}
-
-static inline float max(const float a, const float b) { return a > b? a: b; }
-static inline float min(const float a, const float b) { return a < b? a: b; }
-
-int main(void) {
-  FILE *f = fopen("/Users/tariqs/Documents/projects/learning/learning_c/one_billion_lines/measurements.txt", "r");
-  if (!f) {
+// adds every row of path to places, non-zero on error
+static int aggregate_file(const char *path, stats_table *places) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
     perror("Failed to open file.");
-    return EXIT_FAILURE;
+    return TRUE;
   }
 
-  char *buff = malloc(BUFF_SIZE);
-  if (!buff) {
-    perror("Failed to alloc initial buffer.");
-    fclose(f);
-    return EXIT_FAILURE;
+  // the io thread reads the next BUFF_SIZE chunk while this one is parsed
+  chunk_reader *reader = reader_create(fd, BUFF_SIZE, 2);
+  if (!reader) {
+    perror("Failed to create reader.");
+    close(fd);
+    return TRUE;
   }
 
-  entry_t places[MAX_PLACES] = {0};
-  size_t n_places = 0;
-
-  char *head = buff;
-  char *tail = buff;
-  size_t remainder = 0;
-  size_t bytes_read = 0;
-  while ((bytes_read = fread(buff + remainder, 1, BUFF_SIZE - 1 - remainder, f)) > 0) {
-    *(buff + bytes_read + remainder) = '\0'; // should always be zero, but in case
-
-    char name[NAME_MAX] = {0};
-    size_t name_len = 0;
-    char temp[TEMP_MAX] = {0};
-    size_t temp_len = 0;
-    while (*head != '\0') {
-      if (*head == '\n') {
-        while (*tail != ';') {
-          name[name_len++] = *tail;
-          if (name_len == NAME_MAX - 1) { // ensure that there is always room to null-terminate
-            perror("tried to parse name with too many chars.");
-            free(buff);
-            pclose(f);
-            return EXIT_FAILURE;
-          }
-          tail++;
-        }
-        name[name_len] = '\0';
-        tail++;
-
-        while (tail != head) {
-          temp[temp_len++] = *tail;
-          if (temp_len == TEMP_MAX - 1) { // ensure that there is always room to null-terminate
-            perror("tried to parse temp with too many chars.");
-            free(buff);
-            pclose(f);
-            return EXIT_FAILURE;
-          }
-          tail++;
-        }
-        temp[temp_len] = '\0';
-        float tempf = strtof(temp, NULL);
-
-        entry_t key = {0};
-        strlcpy(key.name, name, NAME_MAX);
-        entry_t *res = bsearch(&key, places, n_places, sizeof(entry_t), entry_cmp);
-        if (res) {
-          res->max = max(tempf, res->max);
-          res->min = min(tempf, res->min);
-          res->sum += tempf;
-          res->n_temps++;
-        } else {
-          places[n_places] = (entry_t) { .max = tempf, .min = tempf, .sum = tempf, .n_temps = 1 };
-          strlcpy(places[n_places].name, name, NAME_MAX);
-          if (!(n_places == 0 || entry_cmp(&key, &places[n_places]) > 0)) {
-            qsort(places, n_places, sizeof(entry_t), entry_cmp);
-          }
-          n_places++;
-        }
-        tail = ++head;
-        name_len = temp_len = 0;
-      } else {
-        head += 1;
+  int err = FALSE;
+  chunk c;
+  while (!err && reader_next(reader, &c)) {
+    str rest = c.data;
+    while (rest.len) {
+      row r;
+      ptrdiff_t len = parse_row(rest, &r);
+      if (len == 0) {
+        fputs("tried to parse malformed row.\n", stderr);
+        err = TRUE;
+        break;
       }
+      if (st_add_hashed(places, r.name, r.hash, r.temp) != 0) {
+        fputs("failed to add place.\n", stderr);
+        err = TRUE;
+        break;
+      }
+      rest = slice(rest.data + len, rest.data + rest.len);
     }
-    if (tail == head - 1) {
-      remainder = 0;
-      head = buff;
-      tail = buff;
-    } else {
-      remainder = strlen(tail);
-      memmove(buff, tail, remainder);
-      tail = head = buff;
-    }
+    reader_release(reader, c);
   }
 
-  if (feof(f)) {
-  } else if (ferror(f)) {
+  if (reader_destroy(&reader) != 0) {
     perror("Error reading from file into buff.");
-    free(buff);
-    fclose(f);
+    err = TRUE;
+  }
+  close(fd);
+  return err;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <file | dir | glob>...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  path_list paths;
+  if (path_list_expand(argv + 1, argc - 1, &paths) != 0) {
+    fputs("No input files found.\n", stderr);
     return EXIT_FAILURE;
   }
 
-  free(buff);
-  printf("Results:\n");
-  for(size_t i = 0; i < n_places; i++) {
-    printf("Name: %s, Mean: %f, Min: %f, Max: %f\n", 
-           places[i].name, places[i].sum/places[i].n_temps, 
-           places[i].min, places[i].max);
-//    free(places[i].place);
+  // names are looked up straight from the chunk, the table copies a name
+  // only the first time it sees it. every file adds into the same table
+  stats_table *places = st_create(STATIONS_HINT);
+  if (!places) {
+    path_list_free(&paths);
+    return EXIT_FAILURE;
+  }
+
+  int err = FALSE;
+  for (size_t i = 0; !err && i < paths.count; ++i) {
+    err = aggregate_file(paths.paths[i], places);
+  }
+  if (!err && write_results(STDOUT_FILENO, places) != 0) {
+    err = TRUE;
   }
-  fclose(f);
-  return EXIT_SUCCESS;
+  st_destroy(&places);
+  path_list_free(&paths);
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
 }
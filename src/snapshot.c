@@ -0,0 +1,173 @@
+#include "snapshot.h"
+#include "output.h"
+#include <stdlib.h>
+#include <string.h>
+
+// key bytes, then length, the order sort_slots gives
+static int _snap_name_cmp(st_slot *a, st_slot *b) {
+  str x = st_key(a);
+  str y = st_key(b);
+  int c = memcmp(x.data, y.data, x.len < y.len ? x.len : y.len);
+  return c ? c : (x.len > y.len) - (x.len < y.len);
+}
+
+static int _snap_by_mean(const void *pa, const void *pb) {
+  st_slot *a = *(st_slot *const *)pa;
+  st_slot *b = *(st_slot *const *)pb;
+  int64_t x = mean_tenths(a->sum, a->count);
+  int64_t y = mean_tenths(b->sum, b->count);
+  return x != y ? (x < y) - (x > y) : _snap_name_cmp(a, b);
+}
+
+static int _snap_by_max(const void *pa, const void *pb) {
+  st_slot *a = *(st_slot *const *)pa;
+  st_slot *b = *(st_slot *const *)pb;
+  return a->max != b->max ? (a->max < b->max) - (a->max > b->max)
+                          : _snap_name_cmp(a, b);
+}
+
+snapshot *snap_build(stats_table *table, uint64_t rows, uint64_t generation) {
+  snapshot *s = calloc(1, sizeof(snapshot));
+  if (s == NULL) {
+    return NULL;
+  }
+  s->rows = rows;
+  s->generation = generation;
+  s->count = st_count(table);
+  s->table = st_create(s->count);
+  size_t n = s->count ? s->count : 1;
+  s->by_name = malloc(3 * n * sizeof(st_slot *));
+  if (s->table == NULL || s->by_name == NULL ||
+      st_merge(s->table, table) != 0) {
+    snap_free(&s);
+    return NULL;
+  }
+  s->by_mean = s->by_name + n;
+  s->by_max = s->by_mean + n;
+
+  size_t i = 0;
+  for (size_t j = 0; j < s->count; ++j) {
+    s->by_name[j] = st_next(s->table, &i);
+  }
+  sort_slots(s->by_name, s->count);
+  memcpy(s->by_mean, s->by_name, s->count * sizeof(st_slot *));
+  memcpy(s->by_max, s->by_name, s->count * sizeof(st_slot *));
+  qsort(s->by_mean, s->count, sizeof(st_slot *), _snap_by_mean);
+  qsort(s->by_max, s->count, sizeof(st_slot *), _snap_by_max);
+
+  s->dump = format_results(s->table);
+  if (!is_valid_str(s->dump)) {
+    snap_free(&s);
+    return NULL;
+  }
+  return s;
+}
+
+void snap_free(snapshot **sp) {
+  if (sp == NULL || *sp == NULL) {
+    return;
+  }
+  snapshot *s = *sp;
+  st_destroy(&s->table);
+  free(s->by_name);
+  free(s->dump.data);
+  free(s);
+  *sp = NULL;
+}
+
+st_slot *snap_get(const snapshot *s, str name) {
+  return s ? st_search(s->table, name) : NULL;
+}
+
+// first index in by_name whose key is not below prefix, when prefixed
+// keys that start with prefix count as below it too
+static size_t _snap_lower(const snapshot *s, str prefix, bool prefixed) {
+  size_t lo = 0;
+  size_t hi = s->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    str key = st_key(s->by_name[mid]);
+    ptrdiff_t n = key.len < prefix.len ? key.len : prefix.len;
+    int c = memcmp(key.data, prefix.data, n);
+    bool below =
+        prefixed ? c <= 0 : c < 0 || (c == 0 && key.len < prefix.len);
+    if (below) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t snap_prefix(const snapshot *s, str prefix, size_t *first) {
+  if (s == NULL || first == NULL || prefix.len < 0) {
+    return 0;
+  }
+  size_t from = _snap_lower(s, prefix, false);
+  size_t to = _snap_lower(s, prefix, true);
+  *first = from;
+  return to - from;
+}
+
+void snap_pub_init(snap_pub *p) {
+  atomic_init(&p->current, NULL);
+  for (size_t i = 0; i < SNAP_READERS; ++i) {
+    atomic_init(&p->hazard[i], NULL);
+  }
+  p->_n_retired = 0;
+}
+
+void snap_pub_destroy(snap_pub *p) {
+  snapshot *s = atomic_exchange(&p->current, NULL);
+  snap_free(&s);
+  for (size_t i = 0; i < p->_n_retired; ++i) {
+    snap_free(&p->_retired[i]);
+  }
+  p->_n_retired = 0;
+}
+
+snapshot *snap_acquire(snap_pub *p, size_t reader) {
+  snapshot *s = atomic_load(&p->current);
+  for (;;) {
+    // announce it, then make sure it was not replaced before the
+    // announcement could be seen. both are sequentially consistent so the
+    // writer's swap and its scan of the hazards can't slip between them
+    atomic_store(&p->hazard[reader], s);
+    snapshot *now = atomic_load(&p->current);
+    if (now == s) {
+      return s;
+    }
+    s = now;
+  }
+}
+
+void snap_release(snap_pub *p, size_t reader) {
+  atomic_store_explicit(&p->hazard[reader], NULL, memory_order_release);
+}
+
+static bool _snap_held(snap_pub *p, snapshot *s) {
+  for (size_t i = 0; i < SNAP_READERS; ++i) {
+    if (atomic_load(&p->hazard[i]) == s) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void snap_publish(snap_pub *p, snapshot *s) {
+  snapshot *old = atomic_exchange(&p->current, s);
+  if (old) {
+    p->_retired[p->_n_retired++] = old;
+  }
+  // each reader holds at most one, so at most SNAP_READERS stay behind
+  size_t kept = 0;
+  for (size_t i = 0; i < p->_n_retired; ++i) {
+    if (_snap_held(p, p->_retired[i])) {
+      p->_retired[kept++] = p->_retired[i];
+    } else {
+      snap_free(&p->_retired[i]);
+    }
+  }
+  p->_n_retired = kept;
+}
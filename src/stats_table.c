@@ -0,0 +1,468 @@
+#include "stats_table.h"
+#include "arena.h"
+#include "hash.h"
+#include "huge.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+const int ST_MAGIC = 0x57A75A75;
+
+static_assert(sizeof(st_slot) == 64, "a slot should be one cache line");
+
+// long keys are bump allocated from an arena that is freed all at once
+#define ST_ARENA_BLOCK (64 * 1024)
+
+struct stats_table {
+  int magic;
+  st_slot *slots;
+  size_t cap; // always a power of two
+  int bits;
+  size_t elements;
+  arena *keys; // created on the first long key
+};
+
+uint64_t st_hash(str key) {
+  return hash_bytes(key.data, key.len);
+}
+
+static inline int _st_is_valid(const stats_table *t) {
+  return t && t->magic == ST_MAGIC;
+}
+
+// top bits of a fibonacci multiply, the cap is 2^bits
+static inline size_t _st_index(uint64_t hash, int bits) {
+  return (size_t)((hash * 11400714819323198485ull) >> (64 - bits));
+}
+
+static inline bool _st_needs_to_grow(size_t elements, size_t capacity) {
+  return (elements + 1) * 2 > capacity;
+}
+
+static unsigned char *_st_arena_copy(stats_table *t, str key) {
+  if (t->keys == NULL) {
+    t->keys = arena_create(ST_ARENA_BLOCK);
+    if (t->keys == NULL) {
+      return NULL;
+    }
+  }
+  return arena_copy(t->keys, key.data, key.len);
+}
+
+str st_key(st_slot *slot) {
+  if (slot == NULL || slot->len == 0) {
+    return (str){0};
+  }
+  unsigned char *p = slot->len > ST_INLINE_KEY ? slot->ext : slot->key;
+  return (str){.data = p, .len = slot->len};
+}
+
+static inline bool _st_matches(st_slot *s, str key, uint64_t hash) {
+  return s->hash == hash && s->len == (uint32_t)key.len &&
+         !memcmp(st_key(s).data, key.data, key.len);
+}
+
+// the slot holding key or the empty slot where it belongs
+static st_slot *_st_probe(stats_table *t, str key, uint64_t hash) {
+  size_t mask = t->cap - 1;
+  size_t idx = _st_index(hash, t->bits);
+  for (;;) {
+    st_slot *s = &t->slots[idx];
+    if (s->len == 0 || _st_matches(s, key, hash)) {
+      return s;
+    }
+    idx = (idx + 1) & mask;
+  }
+}
+
+// non-zero if error
+static int _st_resize(stats_table *t, int bits) {
+  size_t cap = (size_t)1 << bits;
+  st_slot *new = huge_alloc(cap * sizeof(st_slot));
+  if (new == NULL) {
+    return 1;
+  }
+
+  // slots move whole, the cached hash means no key is looked at
+  for (size_t i = 0; i < t->cap; i++) {
+    st_slot *src = &t->slots[i];
+    if (src->len == 0) {
+      continue;
+    }
+    size_t idx = _st_index(src->hash, bits);
+    while (new[idx].len != 0) {
+      idx = (idx + 1) & (cap - 1);
+    }
+    new[idx] = *src;
+  }
+
+  huge_free(t->slots, t->cap * sizeof(st_slot));
+  t->slots = new;
+  t->cap = cap;
+  t->bits = bits;
+  return 0;
+}
+
+stats_table *st_create(size_t cap_hint) {
+  stats_table *t = calloc(1, sizeof(stats_table));
+  if (t == NULL) {
+    return NULL;
+  }
+
+  // keep the load factor at or under a half from the start
+  int bits = 8;
+  while (bits < 62 && ((size_t)1 << bits) < cap_hint * 2) {
+    bits++;
+  }
+
+  t->magic = ST_MAGIC;
+  if (_st_resize(t, bits) != 0) {
+    free(t);
+    return NULL;
+  }
+  return t;
+}
+
+int st_destroy(stats_table **table) {
+  if (table == NULL) {
+    return 1;
+  }
+  stats_table *t = *table;
+  if (!_st_is_valid(t)) {
+    return 2;
+  }
+  if (t->keys) {
+    arena_destroy(&t->keys);
+  }
+  huge_free(t->slots, t->cap * sizeof(st_slot));
+  t->magic = 0; // poison
+  free(t);
+  *table = NULL;
+  return 0;
+}
+
+// claims an empty slot for key, non-zero on error
+static int _st_claim(stats_table *t, st_slot *s, str key, uint64_t hash) {
+  if (key.len > UINT32_MAX) {
+    return 1;
+  }
+  if (key.len > ST_INLINE_KEY) {
+    s->ext = _st_arena_copy(t, key);
+    if (s->ext == NULL) {
+      return 1;
+    }
+  } else {
+    memcpy(s->key, key.data, key.len);
+  }
+  s->hash = hash;
+  s->len = (uint32_t)key.len;
+  s->min = INT16_MAX;
+  s->max = INT16_MIN;
+  t->elements += 1;
+  return 0;
+}
+
+// makes room for one more key, non-zero on error
+static int _st_reserve(stats_table *t) {
+  if (_st_needs_to_grow(t->elements, t->cap)) {
+    if (t->bits >= 62) {
+      return 1;
+    }
+    return _st_resize(t, t->bits + 1);
+  }
+  return 0;
+}
+
+int st_add_hashed(stats_table *table, str key, uint64_t hash, int16_t temp) {
+  if (!_st_is_valid(table) || !is_valid_str(key)) {
+    return 2;
+  }
+
+  st_slot *s = _st_probe(table, key, hash);
+  if (s->len == 0) {
+    // only a new key can push the load factor over, so only then check
+    if (_st_reserve(table) != 0) {
+      return 1;
+    }
+    s = _st_probe(table, key, hash);
+    if (_st_claim(table, s, key, hash) != 0) {
+      return 1;
+    }
+  }
+
+  s->sum += temp;
+  s->count += 1;
+  s->min = temp < s->min ? temp : s->min;
+  s->max = temp > s->max ? temp : s->max;
+  return 0;
+}
+
+int st_add(stats_table *table, str key, int16_t temp) {
+  return st_add_hashed(table, key, st_hash(key), temp);
+}
+
+st_slot *st_search(stats_table *table, str key) {
+  if (!_st_is_valid(table) || !is_valid_str(key)) {
+    return NULL;
+  }
+  st_slot *s = _st_probe(table, key, st_hash(key));
+  return s->len ? s : NULL;
+}
+
+size_t st_count(const stats_table *table) {
+  return _st_is_valid(table) ? table->elements : 0;
+}
+
+st_slot *st_next(stats_table *table, size_t *i) {
+  if (!_st_is_valid(table) || i == NULL) {
+    return NULL;
+  }
+  for (; *i < table->cap; (*i)++) {
+    st_slot *s = &table->slots[*i];
+    if (s->len) {
+      (*i)++;
+      return s;
+    }
+  }
+  return NULL;
+}
+
+int st_merge_slot(stats_table *dst, st_slot *s) {
+  if (!_st_is_valid(dst) || s == NULL || s->len == 0) {
+    return 2;
+  }
+
+  str key = st_key(s);
+  st_slot *d = _st_probe(dst, key, s->hash);
+  if (d->len == 0) {
+    if (_st_reserve(dst) != 0) {
+      return 1;
+    }
+    d = _st_probe(dst, key, s->hash);
+    if (_st_claim(dst, d, key, s->hash) != 0) {
+      return 1;
+    }
+  }
+  d->sum += s->sum;
+  d->count += s->count;
+  d->min = s->min < d->min ? s->min : d->min;
+  d->max = s->max > d->max ? s->max : d->max;
+  return 0;
+}
+
+int st_merge(stats_table *dst, stats_table *src) {
+  if (!_st_is_valid(dst) || !_st_is_valid(src)) {
+    return 2;
+  }
+
+  size_t i = 0;
+  st_slot *s;
+  while ((s = st_next(src, &i))) {
+    if (st_merge_slot(dst, s) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+
+  shared table.
+
+  a slot is claimed by moving its state from empty to claimed with a cas,
+  the winner writes hash and key and then publishes the slot with a
+  release store of ready. a thread that finds a claimed slot spins until
+  it is ready before comparing keys, that window is a few stores long and
+  only happens once per key. after that every row is one probe and a
+  handful of relaxed atomics on a line that threads share. a winner that
+  can't store its key marks the slot failed instead, for good, and every
+  thread that reaches it gives up with an error rather than spin.
+
+*/
+
+enum { SST_EMPTY, SST_CLAIMED, SST_READY, SST_FAILED };
+
+typedef struct {
+  _Atomic uint32_t state;
+  uint32_t len;
+  uint64_t hash;
+  _Atomic int64_t sum;
+  _Atomic int64_t count;
+  _Atomic int16_t min;
+  _Atomic int16_t max;
+  union {
+    unsigned char key[SST_INLINE_KEY];
+    unsigned char *ext; // malloc'd, long names are rare enough
+  };
+} sst_slot;
+
+static_assert(sizeof(sst_slot) == 64, "a shared slot should be one cache line");
+
+struct shared_stats {
+  int magic;
+  sst_slot *slots;
+  size_t cap;
+  int bits;
+  _Atomic size_t elements;
+};
+
+const int SST_MAGIC = 0x5EA7ED57;
+
+static inline int _sst_is_valid(const shared_stats *t) {
+  return t && t->magic == SST_MAGIC;
+}
+
+static inline unsigned char *_sst_key(sst_slot *s) {
+  return s->len > SST_INLINE_KEY ? s->ext : s->key;
+}
+
+shared_stats *sst_create(size_t max_keys) {
+  shared_stats *t = calloc(1, sizeof(shared_stats));
+  if (t == NULL) {
+    return NULL;
+  }
+  // the table never grows, keep it at most half full
+  int bits = 8;
+  while (bits < 62 && ((size_t)1 << bits) < max_keys * 2) {
+    bits++;
+  }
+  t->cap = (size_t)1 << bits;
+  t->bits = bits;
+  t->slots = huge_alloc(t->cap * sizeof(sst_slot));
+  if (t->slots == NULL) {
+    free(t);
+    return NULL;
+  }
+  atomic_init(&t->elements, 0);
+  t->magic = SST_MAGIC;
+  return t;
+}
+
+int sst_destroy(shared_stats **table) {
+  if (table == NULL) {
+    return 1;
+  }
+  shared_stats *t = *table;
+  if (!_sst_is_valid(t)) {
+    return 2;
+  }
+  for (size_t i = 0; i < t->cap; i++) {
+    if (t->slots[i].len > SST_INLINE_KEY) {
+      free(t->slots[i].ext);
+    }
+  }
+  huge_free(t->slots, t->cap * sizeof(sst_slot));
+  t->magic = 0; // poison
+  free(t);
+  *table = NULL;
+  return 0;
+}
+
+// writes the key into a slot this thread just claimed, then publishes it
+// or marks it failed
+static int _sst_publish(sst_slot *s, str key, uint64_t hash) {
+  unsigned char *p = s->key;
+  if (key.len > SST_INLINE_KEY) {
+    p = malloc(key.len);
+    if (p == NULL) {
+      atomic_store_explicit(&s->state, SST_FAILED, memory_order_release);
+      return 1;
+    }
+    s->ext = p;
+  }
+  memcpy(p, key.data, key.len);
+  s->hash = hash;
+  s->len = (uint32_t)key.len;
+  atomic_store_explicit(&s->min, INT16_MAX, memory_order_relaxed);
+  atomic_store_explicit(&s->max, INT16_MIN, memory_order_relaxed);
+  atomic_store_explicit(&s->state, SST_READY, memory_order_release);
+  return 0;
+}
+
+int sst_add_hashed(shared_stats *table, str key, uint64_t hash, int16_t temp) {
+  if (!_sst_is_valid(table) || !is_valid_str(key) || key.len > UINT32_MAX) {
+    return 2;
+  }
+
+  size_t mask = table->cap - 1;
+  size_t idx = _st_index(hash, table->bits);
+  for (size_t probes = 0;; probes++, idx = (idx + 1) & mask) {
+    if (probes == table->cap) {
+      return 1; // full
+    }
+    sst_slot *s = &table->slots[idx];
+    uint32_t state = atomic_load_explicit(&s->state, memory_order_acquire);
+    if (state == SST_EMPTY) {
+      if (atomic_load_explicit(&table->elements, memory_order_relaxed) * 2 >=
+          table->cap) {
+        return 1; // would go over half full
+      }
+      uint32_t expected = SST_EMPTY;
+      if (atomic_compare_exchange_strong_explicit(
+              &s->state, &expected, SST_CLAIMED, memory_order_acq_rel,
+              memory_order_acquire)) {
+        if (_sst_publish(s, key, hash) != 0) {
+          return 1;
+        }
+        atomic_fetch_add_explicit(&table->elements, 1, memory_order_relaxed);
+      } else {
+        state = expected;
+      }
+    }
+    // someone else is writing the key, it's only a few stores away
+    while ((state = atomic_load_explicit(&s->state, memory_order_acquire)) !=
+           SST_READY) {
+      if (state == SST_FAILED) {
+        return 1;
+      }
+    }
+    if (s->hash != hash || s->len != (uint32_t)key.len ||
+        memcmp(_sst_key(s), key.data, key.len) != 0) {
+      continue;
+    }
+
+    atomic_fetch_add_explicit(&s->sum, temp, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->count, 1, memory_order_relaxed);
+    // min and max settle quickly, after that these are plain loads
+    int16_t cur = atomic_load_explicit(&s->min, memory_order_relaxed);
+    while (temp < cur && !atomic_compare_exchange_weak_explicit(
+                             &s->min, &cur, temp, memory_order_relaxed,
+                             memory_order_relaxed))
+      ;
+    cur = atomic_load_explicit(&s->max, memory_order_relaxed);
+    while (temp > cur && !atomic_compare_exchange_weak_explicit(
+                             &s->max, &cur, temp, memory_order_relaxed,
+                             memory_order_relaxed))
+      ;
+    return 0;
+  }
+}
+
+int sst_export(shared_stats *table, stats_table *dst) {
+  if (!_sst_is_valid(table) || !_st_is_valid(dst)) {
+    return 2;
+  }
+  for (size_t i = 0; i < table->cap; i++) {
+    sst_slot *s = &table->slots[i];
+    if (atomic_load_explicit(&s->state, memory_order_acquire) != SST_READY) {
+      continue;
+    }
+    st_slot tmp = {
+        .hash = s->hash,
+        .sum = atomic_load_explicit(&s->sum, memory_order_relaxed),
+        .count = atomic_load_explicit(&s->count, memory_order_relaxed),
+        .min = atomic_load_explicit(&s->min, memory_order_relaxed),
+        .max = atomic_load_explicit(&s->max, memory_order_relaxed),
+        .len = s->len,
+    };
+    if (s->len > ST_INLINE_KEY) {
+      tmp.ext = _sst_key(s);
+    } else {
+      memcpy(tmp.key, _sst_key(s), s->len);
+    }
+    if (st_merge_slot(dst, &tmp) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#define _GNU_SOURCE // cpu_set_t and the affinity calls on glibc
+
+#include "topology.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NODE_ROOT "/sys/devices/system/node"
+
+// parses a sysfs list like 0-3,8,10-11 into set, non-zero on error
+static int _topology_parse_list(const char *list, cpu_set_t *set) {
+  CPU_ZERO(set);
+  const char *p = list;
+  while (*p && *p != '\n') {
+    char *end;
+    long lo = strtol(p, &end, 10);
+    long hi = lo;
+    if (end == p) {
+      return 1;
+    }
+    if (*end == '-') {
+      p = end + 1;
+      hi = strtol(p, &end, 10);
+      if (end == p) {
+        return 1;
+      }
+    }
+    for (long c = lo; c <= hi && c < CPU_SETSIZE; ++c) {
+      CPU_SET(c, set);
+    }
+    p = *end == ',' ? end + 1 : end;
+  }
+  return 0;
+}
+
+// reads one small sysfs file into set, non-zero if it is missing
+static int _topology_read_list(const char *path, cpu_set_t *set) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return 1;
+  }
+  char line[4096];
+  int err = fgets(line, sizeof(line), f) == NULL ||
+            _topology_parse_list(line, set) != 0;
+  fclose(f);
+  return err;
+}
+
+static void _topology_add(topology *t, int cpu, int node) {
+  t->cpus[t->count] = cpu;
+  t->nodes[t->count] = node;
+  t->count++;
+}
+
+int topology_load(topology *t) {
+  *t = (topology){0};
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return 1;
+  }
+  size_t n = CPU_COUNT(&allowed);
+  t->cpus = calloc(n ? n : 1, sizeof(int));
+  t->nodes = calloc(n ? n : 1, sizeof(int));
+  if (t->cpus == NULL || t->nodes == NULL) {
+    topology_free(t);
+    return 1;
+  }
+
+  // a cpu is only listed under its own node, and once
+  cpu_set_t online, cpus;
+  if (_topology_read_list(NODE_ROOT "/online", &online) == 0) {
+    for (int node = 0; node < CPU_SETSIZE; ++node) {
+      char path[64];
+      snprintf(path, sizeof(path), NODE_ROOT "/node%d/cpulist", node);
+      if (!CPU_ISSET(node, &online) || _topology_read_list(path, &cpus) != 0) {
+        continue;
+      }
+      bool used = false;
+      for (int c = 0; c < CPU_SETSIZE && t->count < n; ++c) {
+        if (CPU_ISSET(c, &cpus) && CPU_ISSET(c, &allowed)) {
+          _topology_add(t, c, node);
+          CPU_CLR(c, &allowed);
+          used = true;
+        }
+      }
+      t->node_count += used;
+    }
+  }
+
+  // whatever sysfs did not place, all of it without sysfs
+  bool rest = false;
+  for (int c = 0; c < CPU_SETSIZE && t->count < n; ++c) {
+    if (CPU_ISSET(c, &allowed)) {
+      _topology_add(t, c, 0);
+      rest = true;
+    }
+  }
+  if (t->node_count == 0) {
+    t->node_count = rest;
+  }
+  return t->count == 0;
+}
+
+void topology_free(topology *t) {
+  free(t->cpus);
+  free(t->nodes);
+  *t = (topology){0};
+}
+
+int topology_pin(pthread_attr_t *attr, int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
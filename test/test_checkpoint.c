@@ -0,0 +1,136 @@
+#include "checkpoint.h"
+#include "q_strings.h"
+#include "stats_table.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FN_LIST                                                                \
+  X(round_trip_keeps_stations)                                                 \
+  X(missing_or_damaged_is_refused)                                             \
+  X(matches_only_the_same_prefix)
+
+// a scratch file in the build directory, removed by the caller
+static const char *scratch(char *buf, size_t n, const char *what) {
+  snprintf(buf, n, "build/test_checkpoint_%s_%d", what, (int)getpid());
+  return buf;
+}
+
+static int write_file(const char *path, const char *data) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    return 1;
+  }
+  fputs(data, f);
+  return fclose(f) != 0;
+}
+
+int round_trip_keeps_stations(void) {
+  char path[128];
+  scratch(path, sizeof(path), "trip");
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  static const char long_name[] =
+      "Llanfairpwllgwyngyllgogerychwyrndrobwllllantysilio";
+  CHECK(st_add(t, S("Hamburg"), 120) == 0);
+  CHECK(st_add(t, S("Hamburg"), -35) == 0);
+  CHECK(st_add(t, S(long_name), 7) == 0);
+  ckpt_ident id = {.dev = 1, .ino = 2, .offset = 3, .head = 4, .tail = 5};
+  CHECK(ckpt_save(path, &id, t) == 0);
+
+  stats_table *back = st_create(0);
+  REQUIRE(back);
+  ckpt_ident got = {0};
+  CHECK(ckpt_load(path, &got, back) == 0);
+  CHECK(got.dev == 1 && got.ino == 2 && got.offset == 3 && got.head == 4 &&
+        got.tail == 5);
+  CHECK(st_count(back) == 2);
+  st_slot *s = st_search(back, S("Hamburg"));
+  REQUIRE(s);
+  CHECK(s->min == -35 && s->max == 120 && s->sum == 85 && s->count == 2);
+  s = st_search(back, S(long_name));
+  REQUIRE(s);
+  CHECK(s->min == 7 && s->max == 7 && s->sum == 7 && s->count == 1);
+
+  remove(path);
+  st_destroy(&back);
+  st_destroy(&t);
+  return 0;
+}
+
+int missing_or_damaged_is_refused(void) {
+  char path[128];
+  scratch(path, sizeof(path), "bad");
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  ckpt_ident id = {0};
+  CHECK(ckpt_load(path, &id, t) != 0);
+
+  CHECK(st_add(t, S("Hamburg"), 120) == 0);
+  CHECK(ckpt_save(path, &id, t) == 0);
+  // flip one byte of the record
+  FILE *f = fopen(path, "r+b");
+  REQUIRE(f);
+  fseek(f, sizeof(uint64_t) * 7 + 4, SEEK_SET);
+  int c = fgetc(f);
+  fseek(f, -1, SEEK_CUR);
+  fputc(c ^ 1, f);
+  fclose(f);
+
+  stats_table *back = st_create(0);
+  REQUIRE(back);
+  CHECK(ckpt_load(path, &id, back) != 0);
+
+  // a record claiming a name of nearly 4 GB
+  CHECK(ckpt_save(path, &id, t) == 0);
+  f = fopen(path, "r+b");
+  REQUIRE(f);
+  fseek(f, sizeof(uint64_t) * 7, SEEK_SET);
+  uint32_t huge = UINT32_MAX - 1;
+  fwrite(&huge, sizeof(huge), 1, f);
+  fclose(f);
+  CHECK(ckpt_load(path, &id, back) != 0);
+
+  CHECK(write_file(path, "not a checkpoint") == 0);
+  CHECK(ckpt_load(path, &id, back) != 0);
+
+  remove(path);
+  st_destroy(&back);
+  st_destroy(&t);
+  return 0;
+}
+
+int matches_only_the_same_prefix(void) {
+  char path[128];
+  scratch(path, sizeof(path), "data");
+  static const char rows[] = "Hamburg;12.0\nBulawayo;8.9\n";
+  CHECK(write_file(path, rows) == 0);
+  ckpt_ident id;
+  CHECK(ckpt_identify(path, S(rows), &id) == 0);
+  CHECK(id.offset == 26);
+
+  CHECK(ckpt_matches(&id, path, S("Hamburg;12.0\nBulawayo;8.9\nPalembang;38.8\n")));
+  CHECK(!ckpt_matches(&id, path, S("Hamburg;12.0\nBulawayo;8.8\n")));
+  CHECK(!ckpt_matches(&id, path, S("Hamburg;12.0\n")));
+  CHECK(!ckpt_matches(&id, "build/no such file", S(rows)));
+
+  remove(path);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
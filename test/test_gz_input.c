@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L // truncate
+
+#include "gz_input.h"
+#include "hash.h"
+#include "q_strings.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define FN_LIST                                                                \
+  X(any_split_sees_every_line)                                                 \
+  X(one_member_is_one_part)                                                    \
+  X(damage_is_an_error)                                                        \
+  X(plain_text_is_not_gzip)
+
+// a scratch file in the build directory, removed by the caller
+static const char *scratch(char *buf, size_t n, const char *what) {
+  snprintf(buf, n, "build/test_gz_input_%s_%d", what, (int)getpid());
+  return buf;
+}
+
+// rows of varying length, the last one without its \n
+static str make_text(size_t rows) {
+  unsigned char *p = malloc(rows * 32);
+  ptrdiff_t n = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    n += sprintf((char *)p + n, "station%zu;%zu.%zu\n", i * 7919 % 1000,
+                 i % 90, i % 10);
+  }
+  return (str){.data = p, .len = n - 1};
+}
+
+// text compressed as one member per step bytes, cut anywhere
+static int write_members(const char *path, str text, ptrdiff_t step) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    return 1;
+  }
+  unsigned char *out = malloc(compressBound(step) + 64);
+  for (ptrdiff_t at = 0; at < text.len; at += step) {
+    ptrdiff_t n = text.len - at < step ? text.len - at : step;
+    z_stream z = {0};
+    deflateInit2(&z, 6, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    z.next_in = text.data + at;
+    z.avail_in = (unsigned)n;
+    z.next_out = out;
+    z.avail_out = (unsigned)(compressBound(step) + 64);
+    deflate(&z, Z_FINISH);
+    fwrite(out, 1, z.total_out, f);
+    deflateEnd(&z);
+  }
+  free(out);
+  return fclose(f) != 0;
+}
+
+// an order independent fingerprint of the lines seen
+typedef struct {
+  size_t lines;
+  size_t bytes;
+  uint64_t sum;
+} seen;
+
+static int count_lines(void *ctx, str lines) {
+  seen *s = ctx;
+  while (lines.len) {
+    ptrdiff_t n = find_byte(lines.data, lines.len, '\n') + 1;
+    s->lines++;
+    s->bytes += n;
+    s->sum += hash_bytes(lines.data, n);
+    lines = slice(lines.data + n, lines.data + lines.len);
+  }
+  return 0;
+}
+
+// the text with its last \n restored, as the parts and stitching see it
+static seen expected(str text) {
+  seen s = {0};
+  unsigned char *p = malloc(text.len + 1);
+  memcpy(p, text.data, text.len);
+  p[text.len] = '\n';
+  count_lines(&s, (str){.data = p, .len = text.len + 1});
+  free(p);
+  return s;
+}
+
+// inflates f in n parts and stitches them, non-zero on error
+static int inflate_in(const gz_file *f, size_t n, seen *s, uint64_t *members) {
+  gz_part *parts = calloc(n, sizeof(gz_part));
+  int err = 0;
+  *members = 0;
+  for (size_t i = 0; i < n && !err; ++i) {
+    err = gz_inflate_part(f, f->len * i / n, f->len * (i + 1) / n,
+                          count_lines, s, &parts[i]);
+    *members += parts[i].members;
+  }
+  err = err || gz_stitch(parts, n, count_lines, s);
+  for (size_t i = 0; i < n; ++i) {
+    gz_part_free(&parts[i]);
+  }
+  free(parts);
+  return err;
+}
+
+int any_split_sees_every_line(void) {
+  char path[128];
+  scratch(path, sizeof(path), "multi");
+  str text = make_text(100000);
+  seen want = expected(text);
+  // members much shorter than a line, and much longer than the buffer
+  ptrdiff_t steps[] = {7, 4099, 100000, 3 * GZ_OUT};
+  for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]); ++k) {
+    REQUIRE(write_members(path, text, steps[k]) == 0);
+    CHECK(gz_sniff(path));
+    gz_file f;
+    REQUIRE(gz_open(path, &f) == 0);
+    uint64_t total = (text.len + steps[k] - 1) / steps[k];
+    size_t splits[] = {1, 2, 3, 8, 61};
+    for (size_t j = 0; j < sizeof(splits) / sizeof(splits[0]); ++j) {
+      seen got = {0};
+      uint64_t members;
+      CHECK(inflate_in(&f, splits[j], &got, &members) == 0);
+      CHECK(members == total);
+      CHECK(got.lines == want.lines && got.bytes == want.bytes &&
+            got.sum == want.sum);
+    }
+    gz_close(&f);
+  }
+  remove(path);
+  free(text.data);
+  return 0;
+}
+
+int one_member_is_one_part(void) {
+  char path[128];
+  scratch(path, sizeof(path), "single");
+  str text = make_text(20000);
+  REQUIRE(write_members(path, text, text.len) == 0);
+  gz_file f;
+  REQUIRE(gz_open(path, &f) == 0);
+  gz_part part;
+  seen got = {0};
+  CHECK(gz_inflate_part(&f, f.len / 2, f.len, count_lines, &got, &part) == 0);
+  CHECK(part.members == 0 && part.bytes == 0 && got.lines == 0);
+  gz_part_free(&part);
+  gz_close(&f);
+  remove(path);
+  free(text.data);
+  return 0;
+}
+
+int damage_is_an_error(void) {
+  char path[128];
+  scratch(path, sizeof(path), "bad");
+  str text = make_text(20000);
+  REQUIRE(write_members(path, text, 5000) == 0);
+  gz_file f;
+  REQUIRE(gz_open(path, &f) == 0);
+  size_t len = f.len;
+  gz_close(&f);
+
+  // cut into the last member
+  CHECK(truncate(path, len - 3) == 0);
+  REQUIRE(gz_open(path, &f) == 0);
+  seen got = {0};
+  uint64_t members;
+  CHECK(inflate_in(&f, 1, &got, &members) != 0);
+  gz_close(&f);
+
+  remove(path);
+  free(text.data);
+  return 0;
+}
+
+int plain_text_is_not_gzip(void) {
+  char path[128];
+  scratch(path, sizeof(path), "text");
+  FILE *file = fopen(path, "wb");
+  REQUIRE(file);
+  fputs("Hamburg;12.0\n", file);
+  fclose(file);
+  CHECK(!gz_sniff(path));
+  gz_file f;
+  CHECK(gz_open(path, &f) != 0);
+  CHECK(!gz_sniff("build/no such file"));
+  remove(path);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
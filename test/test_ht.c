@@ -35,6 +35,7 @@ Once the basics pass, add:
 #include "q_strings.h"
 #include "test_helpers.h"
 #include "test_runner.h"
+#include <stdint.h>
 
 #define FN_LIST                                                                \
   X(literal_to_str)                                                            \
@@ -46,13 +47,20 @@ Once the basics pass, add:
   X(correct_key_gets_correct_value)                                            \
   X(setting_twice_updates_value) \
   X(thousands_of_inserts) \
+  X(remove_then_search_misses) \
+  X(remove_keeps_cluster_reachable) \
+  X(iterator_visits_every_key) \
+  X(merge_combines_values) \
+  X(arena_backed_table) \
+  X(arena_respects_alignment) \
+  X(stats_describe_the_slots) \
 
 int literal_to_str(void) {
   str a = {
-      .data = "new key",
+      .data = (unsigned char *)"new key",
       .len = 7,
   };
-  str b = LITERAL_TO_STR("new key");
+  str b = S("new key");
 
   CHECK(are_equal(a, b));
   return 0;
@@ -86,13 +94,10 @@ int empty_search_returns_null(void) {
 
 int incorrect_key_returns_null(void) {
   ht *t = ht_create();
-  str key = {
-      .data = "new key",
-      .len = strlen(key.data),
-  };
+  str key = S("new key");
   str wrong_key = {
-      .data = "wrong key",
-      .len = strlen(key.data),
+      .data = (unsigned char *)"wrong key",
+      .len = key.len,
   };
   int val = 1;
   ht_insert(t, key, &val);
@@ -103,13 +108,10 @@ int incorrect_key_returns_null(void) {
 
 int correct_key_gets_correct_value(void) {
   ht *t = ht_create();
-  str key = {
-      .data = "new key",
-      .len = strlen(key.data),
-  };
+  str key = S("new key");
   str wrong_key = {
-      .data = "wrong key",
-      .len = strlen(key.data),
+      .data = (unsigned char *)"wrong key",
+      .len = key.len,
   };
   int val = 1;
   ht_insert(t, key, &val);
@@ -121,10 +123,7 @@ int correct_key_gets_correct_value(void) {
 
 int setting_twice_updates_value(void) {
   ht *t = ht_create();
-  str key = {
-      .data = "new key",
-      .len = strlen(key.data),
-  };
+  str key = S("new key");
   int val = 1;
   int new_val = 23;
   ht_insert(t, key, &val);
@@ -134,19 +133,20 @@ int setting_twice_updates_value(void) {
   return 0;
 }
 
+// the key is only valid until the next call, the table copies it
 static str gen_key(size_t i) {
-  char buffer[32];
+  static char buffer[32];
   int len = snprintf(buffer, sizeof(buffer), "key_%06zu", i);
 
   return (str){
-    .data = buffer,
-    .len = (size_t)len,
+    .data = (unsigned char *)buffer,
+    .len = len,
   };
 }
 
 // generates a bit string masquerading as a mem addr
 static void *gen_val(size_t i) {
-  return (void *)(uintptr_t)i;;
+  return (void *)(uintptr_t)i;
 }
 
 int thousands_of_inserts(void) {
@@ -160,6 +160,137 @@ int thousands_of_inserts(void) {
   return 0;
 }
 
+int remove_then_search_misses(void) {
+  ht *t = ht_create();
+  str key = S("new key");
+  int val = 1;
+  ht_insert(t, key, &val);
+  CHECK(ht_remove(t, key) == 0);
+  CHECK(ht_search(t, key) == NULL);
+  CHECK(ht_remove(t, key) == 1);
+  CHECK(ht_count(t) == 0);
+  ht_destroy(&t);
+  return 0;
+}
+
+int remove_keeps_cluster_reachable(void) {
+  ht *table = ht_create();
+  for (size_t i = 0; i < 10000; i += 1) {
+    CHECK(ht_insert(table, gen_key(i), gen_val(i + 1)) == 0);
+  }
+  // every other key goes, the survivors must still be found
+  for (size_t i = 0; i < 10000; i += 2) {
+    CHECK(ht_remove(table, gen_key(i)) == 0);
+  }
+  for (size_t i = 0; i < 10000; i += 1) {
+    void *want = i % 2 ? gen_val(i + 1) : NULL;
+    CHECK(ht_search(table, gen_key(i)) == want);
+  }
+  CHECK(ht_count(table) == 5000);
+  ht_destroy(&table);
+  return 0;
+}
+
+int iterator_visits_every_key(void) {
+  ht *table = ht_create();
+  size_t sum = 0;
+  for (size_t i = 0; i < 1000; i += 1) {
+    CHECK(ht_insert(table, gen_key(i), gen_val(i)) == 0);
+    sum += i;
+  }
+  size_t seen = 0;
+  for (ht_iter it = ht_iterator(table); it.key; it = ht_next(it)) {
+    CHECK(ht_search(table, *it.key) == it.value);
+    sum -= (uintptr_t)it.value;
+    seen++;
+  }
+  CHECK(seen == 1000);
+  CHECK(sum == 0);
+  ht_destroy(&table);
+  return 0;
+}
+
+static void *add_vals(void *a, void *b) {
+  return (void *)((uintptr_t)a + (uintptr_t)b);
+}
+
+int merge_combines_values(void) {
+  ht *a = ht_create();
+  ht *b = ht_create();
+  for (size_t i = 0; i < 600; i += 1) {
+    CHECK(ht_insert(a, gen_key(i), gen_val(1)) == 0);
+  }
+  for (size_t i = 300; i < 900; i += 1) {
+    CHECK(ht_insert(b, gen_key(i), gen_val(2)) == 0);
+  }
+  CHECK(ht_merge(a, b, add_vals) == 0);
+  ht_destroy(&b);
+  CHECK(ht_count(a) == 900);
+  for (size_t i = 0; i < 900; i += 1) {
+    uintptr_t want = i < 300 ? 1 : i < 600 ? 3 : 2;
+    CHECK(ht_search(a, gen_key(i)) == gen_val(want));
+  }
+  ht_destroy(&a);
+  return 0;
+}
+
+int arena_backed_table(void) {
+  arena *a = arena_create(4096);
+  REQUIRE(a);
+  ht *table = ht_create_in(a);
+  REQUIRE(table);
+  for (size_t i = 0; i < 10000; i += 1) {
+    size_t *val = arena_alloc(a, sizeof(size_t), alignof(size_t));
+    REQUIRE(val);
+    *val = i;
+    CHECK(ht_insert(table, gen_key(i), val) == 0);
+  }
+  CHECK(ht_remove(table, gen_key(17)) == 0);
+  for (size_t i = 0; i < 10000; i += 1) {
+    size_t *val = ht_search(table, gen_key(i));
+    CHECK(i == 17 ? val == NULL : (val && *val == i));
+  }
+  CHECK(ht_destroy(&table) == 0);
+  CHECK(arena_destroy(&a) == 0);
+  CHECK(a == NULL);
+  return 0;
+}
+
+int arena_respects_alignment(void) {
+  arena *a = arena_create(256);
+  REQUIRE(a);
+  for (size_t align = 1; align <= 4096; align *= 2) {
+    unsigned char *p = arena_alloc(a, 3, align);
+    REQUIRE(p);
+    CHECK(((uintptr_t)p & (align - 1)) == 0);
+  }
+  // larger than a block
+  CHECK(arena_alloc(a, 10000, 8) != NULL);
+  CHECK(arena_alloc(a, 8, 3) == NULL);
+  arena_destroy(&a);
+  return 0;
+}
+
+int stats_describe_the_slots(void) {
+  ht *t = ht_create();
+  ht_shape shape;
+  CHECK(ht_stats(t, &shape) == 0);
+  CHECK(shape.count == 0 && shape.max_probe == 0 && shape.avg_probe == 0);
+  for (int i = 0; i < 1000; i += 1) {
+    ht_insert(t, gen_key(i), gen_val(i));
+  }
+  CHECK(ht_stats(t, &shape) == 0);
+  CHECK(shape.count == 1000);
+  CHECK(shape.cap == ht_capacity(t) && shape.cap >= 2000);
+  CHECK(shape.avg_probe >= 1.0 && shape.max_probe >= 1);
+  CHECK(shape.max_probe >= shape.avg_probe);
+  // every key is 10 bytes
+  CHECK(shape.bytes > 10 * 1000);
+  ht_destroy(&t);
+  CHECK(ht_stats(t, &shape) != 0);
+  return 0;
+}
+
 int two_instance_key_equality(void);
 int near_miss_keys(void);
 
@@ -171,7 +302,9 @@ int consistent_get_returns(void);
 int random_round_trip(void);
 
 #define X(token)                                                               \
-  (test_case){.result = 0, .name = LITERAL_TO_STR(#token), .fn = token},
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
 
 test_case tests[] = {FN_LIST};
 #undef X
@@ -180,6 +313,5 @@ test_case tests[] = {FN_LIST};
 
 int main(void) {
   run_tests(tests, FN_COUNT);
-  results(tests, FN_COUNT);
-  return 0;
-};
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
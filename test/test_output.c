@@ -0,0 +1,112 @@
+#include "output.h"
+#include "q_strings.h"
+#include "stats_table.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FN_LIST                                                                \
+  X(tenths_format_like_printf)                                                 \
+  X(sort_matches_memcmp_order)                                                 \
+  X(results_in_canonical_format)                                               \
+  X(empty_table_is_braces)
+
+int tenths_format_like_printf(void) {
+  unsigned char out[32];
+  char want[32];
+  for (int64_t v = -20000; v <= 20000; ++v) {
+    ptrdiff_t n = format_tenths(out, v);
+    int m = snprintf(want, sizeof(want), "%s%lld.%lld", v < 0 ? "-" : "",
+                     (long long)(llabs(v) / 10), (long long)(llabs(v) % 10));
+    if (n != m || memcmp(out, want, n) != 0) {
+      CHECK(false);
+      return 0;
+    }
+  }
+  ptrdiff_t n = format_tenths(out, INT64_MIN);
+  CHECK(are_equal((str){.data = out, .len = n}, S("-922337203685477580.8")));
+  return 0;
+}
+
+static int memcmp_cmp(const void *a, const void *b) {
+  str x = st_key(*(st_slot *const *)a);
+  str y = st_key(*(st_slot *const *)b);
+  int r = memcmp(x.data, y.data, x.len < y.len ? x.len : y.len);
+  return r ? r : (x.len > y.len) - (x.len < y.len);
+}
+
+int sort_matches_memcmp_order(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  // shared prefixes, prefixes of each other, high bytes and long keys
+  char buffer[64];
+  srand(7);
+  for (int i = 0; i < 3000; ++i) {
+    int len = 1 + rand() % 40;
+    for (int j = 0; j < len; ++j) {
+      buffer[j] = "abA\xc3\xbc"[rand() % 5];
+    }
+    REQUIRE(st_add(t, (str){.data = (unsigned char *)buffer, .len = len}, 1) ==
+            0);
+  }
+
+  size_t n = st_count(t);
+  st_slot **got = malloc(n * sizeof(st_slot *));
+  st_slot **want = malloc(n * sizeof(st_slot *));
+  REQUIRE(got && want);
+  size_t i = 0;
+  for (size_t j = 0; j < n; ++j) {
+    got[j] = want[j] = st_next(t, &i);
+  }
+  sort_slots(got, n);
+  qsort(want, n, sizeof(st_slot *), memcmp_cmp);
+  CHECK(memcmp(got, want, n * sizeof(st_slot *)) == 0);
+
+  free(got);
+  free(want);
+  st_destroy(&t);
+  return 0;
+}
+
+int results_in_canonical_format(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  st_add(t, S("Oslo"), -5);
+  st_add(t, S("Oslo"), 10);
+  st_add(t, S("Abha"), 999);
+  st_add(t, S("Abh"), -999);
+  str out = format_results(t);
+  REQUIRE(is_valid_str(out));
+  CHECK(are_equal(out,
+                  S("{Abh=-99.9/-99.9/-99.9, Abha=99.9/99.9/99.9, "
+                    "Oslo=-0.5/0.3/1.0}\n")));
+  free(out.data);
+  st_destroy(&t);
+  return 0;
+}
+
+int empty_table_is_braces(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  str out = format_results(t);
+  CHECK(are_equal(out, S("{}\n")));
+  free(out.data);
+  st_destroy(&t);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
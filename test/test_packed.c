@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L // truncate
+
+#include "packed.h"
+#include "q_strings.h"
+#include "stats_table.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FN_LIST                                                                \
+  X(round_trip_matches_a_table)                                                \
+  X(empty_file_has_no_stations)                                                \
+  X(damaged_files_are_refused)                                                 \
+  X(overflowing_header_is_refused)                                             \
+  X(dictionary_has_a_limit)
+
+// a scratch file in the build directory, removed by the caller
+static const char *scratch(char *buf, size_t n, const char *what) {
+  snprintf(buf, n, "build/test_packed_%s_%d", what, (int)getpid());
+  return buf;
+}
+
+// the key is only valid until the next call
+static str gen_key(size_t i) {
+  static char buffer[64];
+  // every eighth name is too long to be stored inline in a slot
+  int len = snprintf(buffer, sizeof(buffer), i % 8 ? "s%zu" : "%040zu", i);
+  return (str){.data = (unsigned char *)buffer, .len = len};
+}
+
+// more than two blocks, a short last one
+#define ROWS (2 * PACK_BLOCK_ROWS + 1234)
+
+int round_trip_matches_a_table(void) {
+  char path[128];
+  scratch(path, sizeof(path), "trip");
+  pack_writer *w = pack_create(path);
+  REQUIRE(w);
+  stats_table *want = st_create(0);
+  REQUIRE(want);
+  for (size_t i = 0; i < ROWS; ++i) {
+    int16_t temp = (int16_t)((i * 7919) % 1999) - 999;
+    str key = gen_key(i % 501);
+    CHECK(st_add(want, key, temp) == 0);
+    CHECK(pack_add(w, key, temp) == 0);
+  }
+  CHECK(pack_finish(&w) == 0);
+  CHECK(w == NULL);
+
+  pack_file f;
+  REQUIRE(pack_open(path, &f) == 0);
+  CHECK(f.rows == ROWS);
+  CHECK(f.blocks == 3);
+  CHECK(f.stations == 501);
+  pack_stat *stats = pack_stats_create(f.stations);
+  REQUIRE(stats);
+  int64_t rows = 0;
+  for (size_t b = 0; b < f.blocks; ++b) {
+    rows += pack_aggregate(&f, b, stats);
+  }
+  CHECK(rows == ROWS);
+  CHECK(pack_aggregate(&f, f.blocks, stats) == -1);
+
+  stats_table *got = st_create(0);
+  REQUIRE(got);
+  CHECK(pack_export(&f, stats, got) == 0);
+  CHECK(st_count(got) == st_count(want));
+  size_t i = 0;
+  st_slot *s;
+  while ((s = st_next(want, &i))) {
+    st_slot *g = st_search(got, st_key(s));
+    REQUIRE(g);
+    CHECK(g->sum == s->sum && g->count == s->count && g->min == s->min &&
+          g->max == s->max);
+  }
+
+  st_destroy(&got);
+  st_destroy(&want);
+  free(stats);
+  pack_close(&f);
+  remove(path);
+  return 0;
+}
+
+int empty_file_has_no_stations(void) {
+  char path[128];
+  scratch(path, sizeof(path), "empty");
+  pack_writer *w = pack_create(path);
+  REQUIRE(w);
+  CHECK(pack_finish(&w) == 0);
+  pack_file f;
+  REQUIRE(pack_open(path, &f) == 0);
+  CHECK(f.rows == 0 && f.blocks == 0 && f.stations == 0);
+  pack_close(&f);
+  remove(path);
+  return 0;
+}
+
+int damaged_files_are_refused(void) {
+  char path[128];
+  scratch(path, sizeof(path), "bad");
+  pack_writer *w = pack_create(path);
+  REQUIRE(w);
+  CHECK(pack_add(w, S("Hamburg"), 120) == 0);
+  CHECK(pack_add(w, S("Bulawayo"), 89) == 0);
+  CHECK(pack_finish(&w) == 0);
+
+  // the id of the second row, right after the header and block header
+  FILE *file = fopen(path, "r+b");
+  REQUIRE(file);
+  fseek(file, 64 + 8 + 2, SEEK_SET);
+  fputc(7, file);
+  fclose(file);
+  pack_file f;
+  REQUIRE(pack_open(path, &f) == 0);
+  pack_stat *stats = pack_stats_create(f.stations);
+  REQUIRE(stats);
+  CHECK(pack_aggregate(&f, 0, stats) == -1);
+  free(stats);
+  pack_close(&f);
+
+  // one byte short of the dictionary
+  CHECK(truncate(path, 64 + 8 + 8 + 4 + 7 + 4 + 7) == 0);
+  CHECK(pack_open(path, &f) != 0);
+  CHECK(f.names == NULL);
+
+  file = fopen(path, "wb");
+  REQUIRE(file);
+  fputs("Hamburg;12.0\n", file);
+  fclose(file);
+  CHECK(pack_open(path, &f) != 0);
+  CHECK(pack_open("build/no such file", &f) != 0);
+  remove(path);
+  return 0;
+}
+
+// a row count whose data size wraps around to exactly the real one
+int overflowing_header_is_refused(void) {
+  char path[128];
+  scratch(path, sizeof(path), "wrap");
+  pack_writer *w = pack_create(path);
+  REQUIRE(w);
+  CHECK(pack_add(w, S("Hamburg"), 120) == 0);
+  CHECK(pack_finish(&w) == 0);
+
+  // one row blocks of 12 bytes, 12 * (2^62 + 1) wraps to 12
+  uint64_t rows = (UINT64_C(1) << 62) + 1;
+  uint32_t block_rows = 1;
+  FILE *file = fopen(path, "r+b");
+  REQUIRE(file);
+  fseek(file, 8, SEEK_SET);
+  fwrite(&rows, sizeof(rows), 1, file);
+  fwrite(&rows, sizeof(rows), 1, file);
+  fseek(file, 48, SEEK_SET);
+  fwrite(&block_rows, sizeof(block_rows), 1, file);
+  fclose(file);
+
+  pack_file f;
+  CHECK(pack_open(path, &f) != 0);
+  remove(path);
+  return 0;
+}
+
+int dictionary_has_a_limit(void) {
+  char path[128];
+  scratch(path, sizeof(path), "full");
+  pack_writer *w = pack_create(path);
+  REQUIRE(w);
+  for (size_t i = 0; i < PACK_MAX_STATIONS; ++i) {
+    CHECK(pack_add(w, gen_key(i), 0) == 0);
+  }
+  CHECK(pack_add(w, gen_key(0), 1) == 0);
+  CHECK(pack_add(w, gen_key(PACK_MAX_STATIONS), 1) == 1);
+  pack_discard(&w);
+  CHECK(w == NULL);
+  CHECK(access(path, F_OK) != 0);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
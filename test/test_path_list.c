@@ -0,0 +1,159 @@
+#include "path_list.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FN_LIST                                                                \
+  X(directory_lists_its_files_sorted)                                          \
+  X(glob_expands_in_order)                                                     \
+  X(plain_paths_pass_through)                                                  \
+  X(nothing_found_is_an_error)
+
+// a scratch directory in the build directory, see remove_scratch
+static const char *scratch(char *buf, size_t n) {
+  snprintf(buf, n, "build/test_path_list_%d", (int)getpid());
+  return buf;
+}
+
+static int touch(const char *dir, const char *name) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *f = fopen(path, "wb");
+  return f == NULL || fclose(f) != 0;
+}
+
+static const char *names[] = {"b.txt", "a.txt", "c.csv", ".hidden"};
+
+static int make_scratch(const char *dir) {
+  if (mkdir(dir, 0700) != 0) {
+    return 1;
+  }
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    if (touch(dir, names[i]) != 0) {
+      return 1;
+    }
+  }
+  char sub[256];
+  snprintf(sub, sizeof(sub), "%s/sub", dir);
+  return mkdir(sub, 0700) != 0 || touch(sub, "d.txt") != 0;
+}
+
+static void remove_scratch(const char *dir) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/sub/d.txt", dir);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/sub", dir);
+  rmdir(path);
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+    remove(path);
+  }
+  rmdir(dir);
+}
+
+// whether path is dir/name
+static bool is(const char *path, const char *dir, const char *name) {
+  size_t n = strlen(dir);
+  return strncmp(path, dir, n) == 0 && path[n] == '/' &&
+         strcmp(path + n + 1, name) == 0;
+}
+
+int directory_lists_its_files_sorted(void) {
+  char dir[128];
+  scratch(dir, sizeof(dir));
+  REQUIRE(make_scratch(dir) == 0);
+
+  // subdirectories and dotfiles are left out
+  path_list l;
+  char *args[] = {dir};
+  CHECK(path_list_expand(args, 1, &l) == 0);
+  CHECK(l.count == 3);
+  CHECK(is(l.paths[0], dir, "a.txt"));
+  CHECK(is(l.paths[1], dir, "b.txt"));
+  CHECK(is(l.paths[2], dir, "c.csv"));
+  path_list_free(&l);
+  CHECK(l.paths == NULL && l.count == 0);
+
+  remove_scratch(dir);
+  return 0;
+}
+
+int glob_expands_in_order(void) {
+  char dir[128];
+  scratch(dir, sizeof(dir));
+  REQUIRE(make_scratch(dir) == 0);
+
+  char pattern[160];
+  snprintf(pattern, sizeof(pattern), "%s/*.txt", dir);
+  path_list l;
+  char *args[] = {pattern, dir};
+  CHECK(path_list_expand(args, 2, &l) == 0);
+  CHECK(l.count == 5);
+  CHECK(is(l.paths[0], dir, "a.txt"));
+  CHECK(is(l.paths[1], dir, "b.txt"));
+  CHECK(is(l.paths[2], dir, "a.txt"));
+  CHECK(is(l.paths[4], dir, "c.csv"));
+  path_list_free(&l);
+
+  // the subdirectory matches too but is no input
+  snprintf(pattern, sizeof(pattern), "%s/*", dir);
+  args[0] = pattern;
+  CHECK(path_list_expand(args, 1, &l) == 0);
+  CHECK(l.count == 3);
+  CHECK(is(l.paths[2], dir, "c.csv"));
+  path_list_free(&l);
+
+  remove_scratch(dir);
+  return 0;
+}
+
+int plain_paths_pass_through(void) {
+  // missing files are for whoever opens them to report
+  path_list l;
+  char a[] = "build/no such file";
+  char b[] = "-";
+  char *args[] = {a, b};
+  CHECK(path_list_expand(args, 2, &l) == 0);
+  CHECK(l.count == 2);
+  CHECK(strcmp(l.paths[0], a) == 0 && strcmp(l.paths[1], b) == 0);
+  path_list_free(&l);
+  return 0;
+}
+
+int nothing_found_is_an_error(void) {
+  char dir[128];
+  scratch(dir, sizeof(dir));
+  REQUIRE(mkdir(dir, 0700) == 0);
+
+  path_list l;
+  char *args[] = {dir};
+  CHECK(path_list_expand(args, 1, &l) != 0);
+  CHECK(l.paths == NULL && l.count == 0);
+
+  char pattern[160];
+  snprintf(pattern, sizeof(pattern), "%s/*.txt", dir);
+  args[0] = pattern;
+  CHECK(path_list_expand(args, 1, &l) != 0);
+
+  rmdir(dir);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
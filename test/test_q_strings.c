@@ -0,0 +1,167 @@
+#include "hash.h"
+#include "q_strings.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdint.h>
+
+#define FN_LIST                                                                \
+  X(cut_splits_on_first_delim)                                                 \
+  X(cut_without_delim_is_not_ok)                                               \
+  X(find_byte_matches_scalar)                                                  \
+  X(scan_delims_matches_scalar)                                                \
+  X(scan_delims_short_block)                                                   \
+  X(parse_tenths_full_range)                                                   \
+  X(mean_tenths_rounds_half_up)                                                \
+  X(cut_hash_matches_cut_and_hash)
+
+static ptrdiff_t scalar_find(const unsigned char *p, ptrdiff_t n,
+                             unsigned char c) {
+  ptrdiff_t i = 0;
+  for (; i < n && p[i] != c; i++)
+    ;
+  return i;
+}
+
+// xorshift, deterministic across runs
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+// rows of name;temp\n with names of 1 to 40 bytes
+static void fill_rows(unsigned char *buf, ptrdiff_t n, uint64_t seed) {
+  ptrdiff_t i = 0;
+  while (i < n) {
+    int name = 1 + (int)(next_rand(&seed) % 40);
+    for (int j = 0; j < name && i < n; j++) {
+      buf[i++] = 'a' + next_rand(&seed) % 26;
+    }
+    const char *temp = ";-12.3\n";
+    for (int j = 0; temp[j] && i < n; j++) {
+      buf[i++] = temp[j];
+    }
+  }
+}
+
+int cut_splits_on_first_delim(void) {
+  snip s = cut(S("Hamburg;12.0\nBulawayo;8.9\n"), ';');
+  CHECK(s.ok);
+  CHECK(are_equal(s.head, S("Hamburg")));
+  CHECK(are_equal(s.tail, S("12.0\nBulawayo;8.9\n")));
+  return 0;
+}
+
+int cut_without_delim_is_not_ok(void) {
+  snip s = cut(S("no delimiter in this one at all"), ';');
+  CHECK(!s.ok);
+  CHECK(s.head.len == 31);
+  CHECK(s.tail.len == 0);
+  return 0;
+}
+
+int find_byte_matches_scalar(void) {
+  unsigned char buf[1024];
+  fill_rows(buf, sizeof(buf), 42);
+  for (ptrdiff_t start = 0; start < 64; start++) {
+    for (ptrdiff_t n = 0; n + start <= (ptrdiff_t)sizeof(buf); n += 37) {
+      const unsigned char *p = buf + start;
+      CHECK(find_byte(p, n, ';') == scalar_find(p, n, ';'));
+      CHECK(find_byte(p, n, '\n') == scalar_find(p, n, '\n'));
+      CHECK(find_byte(p, n, 'Z') == n);
+    }
+  }
+  return 0;
+}
+
+int scan_delims_matches_scalar(void) {
+  unsigned char buf[4096];
+  fill_rows(buf, sizeof(buf), 7);
+  for (ptrdiff_t off = 0; off + DELIM_BLOCK <= (ptrdiff_t)sizeof(buf); off++) {
+    delims d = scan_delims(slice(buf + off, buf + off + DELIM_BLOCK));
+    for (int i = 0; i < DELIM_BLOCK; i++) {
+      CHECK(((d.semi >> i) & 1) == (buf[off + i] == ';'));
+      CHECK(((d.nl >> i) & 1) == (buf[off + i] == '\n'));
+    }
+  }
+  return 0;
+}
+
+int scan_delims_short_block(void) {
+  str s = S("ab;1.0\n;;");
+  delims d = scan_delims(slice(s.data, s.data + 7));
+  CHECK(d.semi == (1ULL << 2));
+  CHECK(d.nl == (1ULL << 6));
+  return 0;
+}
+
+int parse_tenths_full_range(void) {
+  char buf[16];
+  for (int v = -999; v <= 999; v++) {
+    int a = v < 0 ? -v : v;
+    int n = snprintf(buf, sizeof(buf), "%s%d.%d\nnext;", v < 0 ? "-" : "",
+                     a / 10, a % 10);
+    ptrdiff_t len = 0;
+    // both with bytes to spare and with the number at the very end
+    CHECK(parse_tenths(slice((unsigned char *)buf, (unsigned char *)buf + n),
+                       &len) == v);
+    CHECK(len == n - 6);
+    CHECK(parse_tenths(slice((unsigned char *)buf,
+                             (unsigned char *)buf + len),
+                       &len) == v);
+  }
+  return 0;
+}
+
+int mean_tenths_rounds_half_up(void) {
+  CHECK(mean_tenths(3, 2) == 2);
+  CHECK(mean_tenths(-3, 2) == -1);
+  CHECK(mean_tenths(-5, 3) == -2);
+  CHECK(mean_tenths(10, 4) == 3);
+  CHECK(mean_tenths(0, 7) == 0);
+  return 0;
+}
+
+int cut_hash_matches_cut_and_hash(void) {
+  unsigned char buf[128];
+  memset(buf, 'x', sizeof(buf));
+  for (ptrdiff_t key = 0; key < 40; key++) {
+    for (ptrdiff_t extra = 0; extra < 12; extra++) {
+      // key bytes, then ; unless extra is 0, then a few more bytes
+      ptrdiff_t n = key + extra;
+      for (ptrdiff_t i = 0; i < n; i++) {
+        buf[i] = 'a' + (i * 7 + key) % 26;
+      }
+      if (extra) {
+        buf[key] = ';';
+      }
+      str s = slice(buf, buf + n);
+      uint64_t h = 0;
+      snip a = cut_hash(s, ';', &h);
+      snip b = cut(s, ';');
+      CHECK(a.ok == b.ok);
+      CHECK(a.head.len == b.head.len && a.tail.len == b.tail.len);
+      if (n) {
+        CHECK(h == hash_bytes(b.head.data, b.head.len));
+      }
+    }
+  }
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -6,14 +6,17 @@ void run_tests(test_case *tests, size_t n) {
   }
 }
 
-void results(test_case *tests, size_t n) {
-  str ok = {.data = "PASS", .len = 4};
-  str fail = {.data = "FAIL", .len = 4};
+int results(test_case *tests, size_t n) {
+  str ok = S("PASS");
+  str fail = S("FAIL");
   str *s = NULL;
+  int failed = 0;
   for (size_t i = 0; i < n; i++) {
     test_case t = tests[i];
     s = t.result ? &fail : &ok;
+    failed += t.result != 0;
     fprintf(stdout, "[%4.4s], %s\n", s->data, tests[i].name.data);
   }
   fprintf(stdout, "\n");
+  return failed;
 }
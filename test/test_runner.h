@@ -13,4 +13,5 @@ typedef struct {
 void run_tests(test_case *tests, size_t n);
 
 // prints the names and results of the tests
-void results(test_case *tests, size_t n);
+// returns the number of failed tests
+int results(test_case *tests, size_t n);
@@ -0,0 +1,112 @@
+#include "hash.h"
+#include "q_strings.h"
+#include "schema.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FN_LIST                                                                \
+  X(checked_accepts_every_temperature)                                         \
+  X(checked_rejects_malformed_rows)                                            \
+  X(fast_path_agrees_with_checked)
+
+// room for a fast path row and the padding behind it
+#define ROW_BUFFER (SCHEMA_ROW_MAX + 64)
+
+int checked_accepts_every_temperature(void) {
+  char line[32];
+  for (int v = SCHEMA_TEMP_MIN; v <= SCHEMA_TEMP_MAX; ++v) {
+    int len = snprintf(line, sizeof(line), "Oslo;%s%d.%d\n", v < 0 ? "-" : "",
+                       abs(v) / 10, abs(v) % 10);
+    str s = {.data = (unsigned char *)line, .len = len};
+    row r;
+    if (parse_row_checked(s, &r) != len || r.temp != v ||
+        !are_equal(r.name, S("Oslo")) || r.hash != hash_bytes(r.name.data, 4)) {
+      CHECK(false);
+      return 0;
+    }
+  }
+  return 0;
+}
+
+int checked_rejects_malformed_rows(void) {
+  const char *bad[] = {
+      "Oslo\n",       ";1.0\n",     "Oslo;1.0",    "Oslo;1\n",
+      "Oslo;.5\n",    "Oslo;-.5\n", "Oslo;100.0\n", "Oslo;1.05\n",
+      "Oslo;+1.0\n",  "Oslo;1,0\n", "Os\nlo;1.0\n", "Oslo;--1.0\n",
+      "Oslo;1.0;\n",
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    str s = {.data = (unsigned char *)bad[i], .len = strlen(bad[i])};
+    row r;
+    CHECK(parse_row_checked(s, &r) == 0);
+  }
+
+  char name[SCHEMA_NAME_MAX + 16];
+  memset(name, 'a', sizeof(name));
+  memcpy(name + SCHEMA_NAME_MAX, ";1.0\n", 5);
+  str s = {.data = (unsigned char *)name, .len = SCHEMA_NAME_MAX + 5};
+  row r;
+  CHECK(parse_row_checked(s, &r) == SCHEMA_NAME_MAX + 5);
+  memcpy(name + SCHEMA_NAME_MAX, "a;1.0\n", 6);
+  s.len++;
+  CHECK(parse_row_checked(s, &r) == 0);
+  return 0;
+}
+
+// random numbers made of the bytes a temperature is made of, behind a
+// name that now and then holds a \n or ; and in front of enough padding
+// for the fast path to run
+int fast_path_agrees_with_checked(void) {
+  unsigned char buffer[ROW_BUFFER];
+  const char alphabet[] = "-.0123456789\n;x";
+  const char name_bytes[] = "nnnnnnnnnnnnnn\n;";
+  srand(11);
+  for (int i = 0; i < 500000; ++i) {
+    memset(buffer, 'z', sizeof(buffer));
+    int name = 1 + rand() % 12;
+    for (int j = 0; j < name; ++j) {
+      buffer[j] = name_bytes[rand() % (sizeof(name_bytes) - 1)];
+    }
+    buffer[name] = ';';
+    int len = 1 + rand() % 7;
+    for (int j = 0; j < len; ++j) {
+      buffer[name + 1 + j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    str s = {.data = buffer, .len = sizeof(buffer)};
+    row fast, checked;
+    ptrdiff_t a = parse_row(s, &fast);
+    ptrdiff_t b = parse_row_checked(s, &checked);
+    if (a != b || (a && (fast.temp != checked.temp ||
+                         !are_equal(fast.name, checked.name) ||
+                         fast.hash != checked.hash))) {
+      fprintf(stderr, "%.*s\n", name + 1 + len, buffer);
+      CHECK(false);
+      return 0;
+    }
+  }
+
+  // a row missing its ';' must not run into the next row's name
+  memset(buffer, 'z', sizeof(buffer));
+  memcpy(buffer, "Oslo\nBergen;1.0\n", 16);
+  str s = {.data = buffer, .len = sizeof(buffer)};
+  row r;
+  CHECK(parse_row(s, &r) == 0);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
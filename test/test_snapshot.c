@@ -0,0 +1,176 @@
+#include "q_strings.h"
+#include "snapshot.h"
+#include "stats_table.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define FN_LIST                                                                \
+  X(snapshot_is_a_copy)                                                        \
+  X(prefix_ranges)                                                             \
+  X(top_orders)                                                                \
+  X(readers_see_whole_snapshots)
+
+static bool key_is(st_slot *s, str want) {
+  return s && are_equal(st_key(s), want);
+}
+
+int snapshot_is_a_copy(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  CHECK(st_add(t, S("Hamburg"), 120) == 0);
+  CHECK(st_add(t, S("Hamburg"), -35) == 0);
+  snapshot *s = snap_build(t, 2, 1);
+  REQUIRE(s);
+  CHECK(st_add(t, S("Hamburg"), 300) == 0);
+  CHECK(st_add(t, S("Bulawayo"), 89) == 0);
+
+  CHECK(s->count == 1 && s->rows == 2 && s->generation == 1);
+  st_slot *h = snap_get(s, S("Hamburg"));
+  REQUIRE(h);
+  CHECK(h->max == 120 && h->count == 2);
+  CHECK(snap_get(s, S("Bulawayo")) == NULL);
+  CHECK(are_equal(s->dump, S("{Hamburg=-3.5/4.3/12.0}\n")));
+  snap_free(&s);
+  CHECK(s == NULL);
+  st_destroy(&t);
+  return 0;
+}
+
+int prefix_ranges(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  const char *names[] = {"Ab", "Abc", "Abd", "Abdz", "B", "Ba", "a"};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    str key = {.data = (unsigned char *)names[i], .len = strlen(names[i])};
+    CHECK(st_add(t, key, (int16_t)i) == 0);
+  }
+  snapshot *s = snap_build(t, 7, 1);
+  REQUIRE(s);
+
+  size_t first = 99;
+  CHECK(snap_prefix(s, S("Ab"), &first) == 4);
+  CHECK(first == 0 && key_is(s->by_name[3], S("Abdz")));
+  CHECK(snap_prefix(s, S("Abd"), &first) == 2);
+  CHECK(key_is(s->by_name[first], S("Abd")));
+  CHECK(snap_prefix(s, S("B"), &first) == 2);
+  CHECK(key_is(s->by_name[first], S("B")));
+  CHECK(snap_prefix(s, S("Abe"), &first) == 0);
+  CHECK(snap_prefix(s, S("c"), &first) == 0 && first == 7);
+  CHECK(snap_prefix(s, (str){0}, &first) == 7 && first == 0);
+  snap_free(&s);
+  st_destroy(&t);
+  return 0;
+}
+
+int top_orders(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  // means 5.0, 1.0, 5.0 and maxes 6.0, 9.0, 6.0
+  CHECK(st_add(t, S("c"), 40) == 0);
+  CHECK(st_add(t, S("c"), 60) == 0);
+  CHECK(st_add(t, S("b"), -70) == 0);
+  CHECK(st_add(t, S("b"), 90) == 0);
+  CHECK(st_add(t, S("a"), 50) == 0);
+  CHECK(st_add(t, S("a"), 60) == 0);
+  CHECK(st_add(t, S("a"), 40) == 0);
+  snapshot *s = snap_build(t, 7, 1);
+  REQUIRE(s);
+  CHECK(key_is(s->by_mean[0], S("a")));
+  CHECK(key_is(s->by_mean[1], S("c")));
+  CHECK(key_is(s->by_mean[2], S("b")));
+  CHECK(key_is(s->by_max[0], S("b")));
+  CHECK(key_is(s->by_max[1], S("a")));
+  CHECK(key_is(s->by_max[2], S("c")));
+  snap_free(&s);
+  st_destroy(&t);
+  return 0;
+}
+
+#define THREADS 4
+#define GENERATIONS 2000
+
+typedef struct {
+  snap_pub *pub;
+  size_t id;
+  _Atomic bool *done;
+  int err;
+} reader_arg;
+
+// every snapshot has generation stations, each counted generation times
+static void *read_loop(void *p) {
+  reader_arg *a = p;
+  uint64_t last = 0;
+  while (!atomic_load(a->done)) {
+    snapshot *s = snap_acquire(a->pub, a->id);
+    if (s->generation < last || s->count != s->generation) {
+      a->err = 1;
+    }
+    for (size_t i = 0; i < s->count; ++i) {
+      a->err |= s->by_name[i]->count != (int64_t)s->generation;
+    }
+    last = s->generation;
+    snap_release(a->pub, a->id);
+  }
+  return a;
+}
+
+int readers_see_whole_snapshots(void) {
+  static snap_pub pub;
+  snap_pub_init(&pub);
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  CHECK(st_add(t, S("s0"), 0) == 0);
+  snap_publish(&pub, snap_build(t, 1, 1));
+
+  _Atomic bool done = false;
+  pthread_t threads[THREADS];
+  reader_arg args[THREADS];
+  for (size_t i = 0; i < THREADS; ++i) {
+    args[i] = (reader_arg){.pub = &pub, .id = i, .done = &done};
+    REQUIRE(pthread_create(&threads[i], NULL, read_loop, &args[i]) == 0);
+  }
+
+  char buf[16];
+  for (uint64_t g = 2; g <= GENERATIONS; ++g) {
+    // every station gets one more row, then a new one is added
+    size_t i = 0;
+    st_slot *slot;
+    while ((slot = st_next(t, &i))) {
+      slot->count++;
+    }
+    int len = snprintf(buf, sizeof(buf), "s%llu", (unsigned long long)g);
+    str key = {.data = (unsigned char *)buf, .len = len};
+    for (uint64_t k = 0; k < g; ++k) {
+      CHECK(st_add(t, key, 0) == 0);
+    }
+    snapshot *s = snap_build(t, g, g);
+    REQUIRE(s);
+    snap_publish(&pub, s);
+  }
+  atomic_store(&done, true);
+  for (size_t i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+    CHECK(args[i].err == 0);
+  }
+  snap_pub_destroy(&pub);
+  st_destroy(&t);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include "q_strings.h"
+#include "stats_table.h"
+#include "test_helpers.h"
+#include "test_runner.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define FN_LIST                                                                \
+  X(create_returns_nonnull)                                                    \
+  X(double_destroy)                                                            \
+  X(add_tracks_min_max_sum)                                                    \
+  X(long_keys_round_trip)                                                      \
+  X(thousands_of_keys)                                                         \
+  X(merge_combines_and_copies)                                                \
+  X(shared_adds_from_threads)                                                  \
+  X(shared_refuses_past_capacity)
+
+// the key is only valid until the next call, the table copies it
+static str gen_key(size_t i) {
+  static char buffer[32];
+  int len = snprintf(buffer, sizeof(buffer), "station_%06zu", i);
+  return (str){.data = (unsigned char *)buffer, .len = len};
+}
+
+int create_returns_nonnull(void) {
+  stats_table *t = st_create(0);
+  CHECK(t);
+  CHECK(st_count(t) == 0);
+  st_destroy(&t);
+  return 0;
+}
+
+int double_destroy(void) {
+  stats_table *t = st_create(0);
+  st_destroy(&t);
+  CHECK(st_destroy(&t));
+  return 0;
+}
+
+int add_tracks_min_max_sum(void) {
+  stats_table *t = st_create(16);
+  REQUIRE(t);
+  CHECK(st_add(t, S("Hamburg"), 120) == 0);
+  CHECK(st_add(t, S("Hamburg"), -35) == 0);
+  CHECK(st_add(t, S("Hamburg"), 7) == 0);
+  st_slot *s = st_search(t, S("Hamburg"));
+  REQUIRE(s);
+  CHECK(s->min == -35);
+  CHECK(s->max == 120);
+  CHECK(s->sum == 92);
+  CHECK(s->count == 3);
+  CHECK(st_search(t, S("Hamburg ")) == NULL);
+  CHECK(st_count(t) == 1);
+  st_destroy(&t);
+  return 0;
+}
+
+int long_keys_round_trip(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  str key = S("Llanfairpwllgwyngyllgogerychwyrndrobwllllantysiliogogogoch");
+  CHECK(key.len > ST_INLINE_KEY);
+  CHECK(st_add(t, key, 10) == 0);
+  CHECK(st_add(t, key, 20) == 0);
+  st_slot *s = st_search(t, key);
+  REQUIRE(s);
+  CHECK(are_equal(st_key(s), key));
+  CHECK(s->count == 2);
+  st_destroy(&t);
+  return 0;
+}
+
+int thousands_of_keys(void) {
+  stats_table *t = st_create(0);
+  REQUIRE(t);
+  for (size_t i = 0; i < 10000; i++) {
+    CHECK(st_add(t, gen_key(i), (int16_t)(i % 1000)) == 0);
+  }
+  CHECK(st_count(t) == 10000);
+  for (size_t i = 0; i < 10000; i++) {
+    st_slot *s = st_search(t, gen_key(i));
+    REQUIRE(s);
+    CHECK(s->sum == (int64_t)(i % 1000));
+  }
+
+  size_t seen = 0;
+  size_t it = 0;
+  while (st_next(t, &it)) {
+    seen++;
+  }
+  CHECK(seen == 10000);
+  st_destroy(&t);
+  return 0;
+}
+
+int merge_combines_and_copies(void) {
+  stats_table *a = st_create(0);
+  stats_table *b = st_create(0);
+  REQUIRE(a && b);
+  st_add(a, S("Accra"), 300);
+  st_add(b, S("Accra"), -10);
+  st_add(b, S("Oslo"), 55);
+  CHECK(st_merge(a, b) == 0);
+  st_destroy(&b);
+
+  st_slot *s = st_search(a, S("Accra"));
+  REQUIRE(s);
+  CHECK(s->min == -10 && s->max == 300 && s->count == 2);
+  s = st_search(a, S("Oslo"));
+  REQUIRE(s);
+  CHECK(are_equal(st_key(s), S("Oslo")));
+  CHECK(st_count(a) == 2);
+  st_destroy(&a);
+  return 0;
+}
+
+#define SHARED_THREADS 4
+#define SHARED_ROWS 20000
+
+// every thread adds the same rows, keys are built locally since gen_key
+// hands out a shared buffer
+static void *shared_adder(void *arg) {
+  shared_stats *t = arg;
+  char buffer[32];
+  for (int i = 0; i < SHARED_ROWS; ++i) {
+    int len = snprintf(buffer, sizeof(buffer), "station_%03d", i % 500);
+    str key = {.data = (unsigned char *)buffer, .len = len};
+    if (sst_add_hashed(t, key, st_hash(key), (int16_t)(i / 500 - 20)) != 0) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+int shared_adds_from_threads(void) {
+  shared_stats *t = sst_create(500);
+  REQUIRE(t);
+  pthread_t threads[SHARED_THREADS];
+  for (int i = 0; i < SHARED_THREADS; ++i) {
+    REQUIRE(pthread_create(&threads[i], NULL, shared_adder, t) == 0);
+  }
+  for (int i = 0; i < SHARED_THREADS; ++i) {
+    void *err;
+    pthread_join(threads[i], &err);
+    CHECK(err == NULL);
+  }
+
+  stats_table *out = st_create(0);
+  REQUIRE(out);
+  CHECK(sst_export(t, out) == 0);
+  CHECK(st_count(out) == 500);
+  st_slot *s = st_search(out, S("station_000"));
+  REQUIRE(s);
+  CHECK(s->count == SHARED_THREADS * SHARED_ROWS / 500);
+  CHECK(s->min == -20 && s->max == 19);
+  st_destroy(&out);
+  CHECK(sst_destroy(&t) == 0);
+  CHECK(sst_destroy(&t));
+  return 0;
+}
+
+int shared_refuses_past_capacity(void) {
+  // the smallest table has 256 slots and holds half of them
+  shared_stats *t = sst_create(1);
+  REQUIRE(t);
+  size_t i = 0;
+  for (; i < 1000; ++i) {
+    str key = gen_key(i);
+    if (sst_add_hashed(t, key, st_hash(key), 1) != 0) {
+      break;
+    }
+  }
+  CHECK(i == 128);
+  str key = S("Llanfairpwllgwyngyllgogerychwyrndrobwllllantysiliogogogoch");
+  CHECK(sst_add_hashed(t, key, st_hash(key), 1) != 0);
+  // keys that are already in still count
+  key = gen_key(3);
+  CHECK(sst_add_hashed(t, key, st_hash(key), 1) == 0);
+  sst_destroy(&t);
+  return 0;
+}
+
+#define X(token)                                                               \
+  {.result = 0,                                                               \
+   .name = {.data = (unsigned char *)#token, .len = sizeof(#token) - 1},       \
+   .fn = token},
+
+test_case tests[] = {FN_LIST};
+#undef X
+
+#define FN_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main(void) {
+  run_tests(tests, FN_COUNT);
+  return results(tests, FN_COUNT) ? EXIT_FAILURE : EXIT_SUCCESS;
+}